@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace clipmap
+{
+
+// fast BCn encoder for page ingest, plus decoder for checking on cpu
+class BlockCompress
+{
+public:
+    enum class Format
+    {
+        BC1,    // rgb, 8 bytes per block
+        BC3,    // rgba, 16 bytes per block
+        BC4,    // r, 8 bytes per block
+        BC5,    // rg, 16 bytes per block
+    };
+
+public:
+    // components per pixel of the uncompressed side: 4, 4, 1, 2
+    static int SrcChannels(Format fmt);
+    static size_t BlockBytes(Format fmt);
+    static size_t CalcSize(Format fmt, int width, int height);
+
+    // width and height must be multiples of 4
+    static void Encode(Format fmt, const uint8_t* src, int width, int height,
+        uint8_t* dst, int thread_num = 1);
+    static void Decode(Format fmt, const uint8_t* src, int width, int height,
+        uint8_t* dst);
+
+}; // BlockCompress
+
+}
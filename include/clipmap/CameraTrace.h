@@ -0,0 +1,51 @@
+#pragma once
+
+#include <SM_Vector.h>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace clipmap
+{
+
+// sequence of Clipmap::Update() arguments, for replaying camera motion
+class CameraTrace
+{
+public:
+    struct Frame
+    {
+        float    scale = 1;
+        // top left of the view, in level 0 texels
+        sm::vec2 offset;
+    };
+
+public:
+    // move offset by step every frame
+    static CameraTrace LinearPan(size_t frame_num, float scale,
+        const sm::vec2& start, const sm::vec2& step);
+    // zoom around center, scale changes exponentially
+    static CameraTrace ZoomDive(size_t frame_num, const sm::vec2& center,
+        float scale_begin, float scale_end, float view_size = 512);
+    // teleport inside [0, extent) every frame
+    static CameraTrace RandomJumps(size_t frame_num, const sm::vec2& extent,
+        float scale_min, float scale_max, uint32_t seed = 0);
+    // view center on a circle, one loop
+    static CameraTrace Orbit(size_t frame_num, const sm::vec2& center,
+        float radius, float scale, float view_size = 512);
+
+    // recorded traces, text file with "scale x y" per line
+    bool Load(const std::string& filepath);
+    bool Save(const std::string& filepath) const;
+
+    void Record(float scale, const sm::vec2& offset);
+
+    auto& GetFrames() const { return m_frames; }
+
+private:
+    std::vector<Frame> m_frames;
+
+}; // CameraTrace
+
+}
@@ -1,15 +1,19 @@
 #pragma once
 
+#include "clipmap/PageService.h"
 #include "clipmap/PageCache.h"
 #include "clipmap/TextureStack.h"
+#include "clipmap/EvictPolicy.h"
+#include "clipmap/Stats.h"
+#include "clipmap/UploadBudget.h"
+#include "clipmap/FrustumFootprint.h"
 
-#include <textile/PageIndexer.h>
-#include <textile/PageLoader.h>
 #include <textile/VTexInfo.h>
 
 #include <boost/noncopyable.hpp>
 
 #include <string>
+#include <memory>
 
 namespace clipmap
 {
@@ -17,32 +21,112 @@ namespace clipmap
 class Clipmap : private boost::noncopyable
 {
 public:
-    Clipmap(const std::string& filepath, const textile::VTexInfo& info);
+    // io_thread_num > 0 streams pages on background workers
+    // cache_budget is in bytes, 0 for the default 256 pages
+    Clipmap(const std::string& filepath, const textile::VTexInfo& info,
+        size_t io_thread_num = 0, size_t cache_budget = 0,
+        const Config& cfg = Config());
+    // one view of a shared service, the views load each page once and
+    // evict it only when no view shows it
+    Clipmap(const std::shared_ptr<PageService>& service, const Config& cfg = Config());
+    ~Clipmap();
 
     void Init(const ur::Device& dev);
 
+    // ring size, level count, formats and viewport, only the changed
+    // layers are reallocated
+    void SetConfig(const ur::Device& dev, const Config& cfg);
+    auto& GetConfig() const { return m_stack.GetConfig(); }
+
     void Update(const ur::Device& dev, ur::Context& ctx,
         float scale, const sm::vec2& offset);
+    // perspective camera over the ground plane z = 0, each level is loaded
+    // only where the view needs it. no prefetch in this mode
+    void Update(const ur::Device& dev, ur::Context& ctx,
+        const sm::mat4& view_proj, const FrustumFootprint::Params& params);
     void GetRegion(float& scale, sm::vec2& offset) const;
 
     void Draw(const ur::Device& dev, ur::Context& ctx,
         float screen_width, float screen_height) const;
     void DebugDraw(const ur::Device& dev, ur::Context& ctx) const;
 
+    // cache settings apply to every view of the service
+    void SetCacheBudget(const ur::Device& dev, size_t budget_bytes) {
+        m_service->GetCache().SetBudget(dev, budget_bytes);
+    }
+    // the device max texture size, caps the pages a budget can buy
+    void SetMaxPoolSize(const ur::Device& dev, int max_size) {
+        m_service->GetCache().SetMaxPoolSize(dev, max_size);
+    }
+    void SetEvictPolicy(const std::shared_ptr<EvictPolicy>& policy) {
+        m_service->GetCache().SetEvictPolicy(policy);
+    }
+    void SetMipQuota(int mip, size_t max_pages) {
+        m_service->GetCache().SetMipQuota(mip, max_pages);
+    }
+    void EnablePageCompression(const ur::Device& dev, bool enable) {
+        m_service->GetCache().EnableCompression(dev, enable);
+    }
+    bool EnablePageMapping() {
+        return m_service->EnableMapping();
+    }
+    // compressed copies in ram of pages read from the file, 0 to disable
+    void EnableRamCache(size_t budget_bytes) {
+        m_service->GetCache().EnableRamCache(budget_bytes);
+    }
+
+    // cap on pages written per Update(), by count, bytes or time, 0 for no
+    // limit on that axis. the rest is written over the following frames
+    void SetUploadBudget(size_t max_pages, size_t max_bytes = 0, int64_t max_us = 0) {
+        m_budget.Set(max_pages, max_bytes, max_us);
+    }
+    size_t GetPendingPages() const { return m_stack.GetPendingCount(); }
+    // cap on loads queued on the streaming workers, so fast moves do not
+    // queue pages they leave behind, 0 for no limit
+    void SetMaxLoadsInFlight(size_t max_num) {
+        m_service->GetCache().SetMaxLoadsInFlight(max_num);
+    }
+
+    // extrapolate camera motion for frame_num frames and load the pages
+    // it will expose, at most budget pages queued, only when streaming
+    void EnablePrefetch(int frame_num, size_t budget);
+
+    auto& GetStack() const { return m_stack; }
+    auto& GetService() const { return m_service; }
+
+    // a frame is from one Update() to the next
+    auto& GetStats() const { return m_stats; }
+    void ResetStats() { m_stats.Reset(); }
+
     auto& GetAllLayers() const { return m_stack.GetAllLayers(); }
     size_t GetStackTexSize() const { return m_stack.GetTextureSize(); }
 
 private:
-    textile::VTexInfo m_info;
+    void BeginFrame();
+    void EndFrame(const ur::Device& dev, ur::Context& ctx);
 
-    textile::PageIndexer m_indexer;
-    textile::PageLoader  m_loader;
+    void PrefetchPages(float scale, const sm::vec2& offset);
 
-    PageCache m_cache;
+private:
+    std::shared_ptr<PageService> m_service;
 
     TextureStack m_stack;
 
-    sm::rect m_viewport = sm::rect(0, 0, 512, 512);
+    sm::rect m_viewport;
+
+    // scratch of the frustum Update()
+    std::vector<sm::rect> m_regions;
+
+    StatsRecorder m_stats;
+
+    UploadBudget m_budget;
+
+    // prefetch
+    int      m_prefetch_frames = 0;
+    float    m_last_scale = 0;
+    sm::vec2 m_last_offset;
+    float    m_scale_vel = 1;
+    sm::vec2 m_offset_vel;
 
 }; // Clipmap
 
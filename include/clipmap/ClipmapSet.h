@@ -0,0 +1,81 @@
+#pragma once
+
+#include "clipmap/PageService.h"
+#include "clipmap/TextureStack.h"
+#include "clipmap/Stats.h"
+#include "clipmap/UploadBudget.h"
+
+#include <textile/VTexInfo.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace clipmap
+{
+
+// clipmaps of several textures with one layout, such as albedo, normal and
+// height of a terrain. regions and diff pages are computed once, each page
+// coordinate is requested from all channels back to back.
+// every channel keeps its own PageService, with its own pool and streaming
+// workers, the loads of one coordinate are not merged into one read
+class ClipmapSet : private boost::noncopyable
+{
+public:
+    // one file per channel, same size and tile size for all
+    // io_thread_num and cache_budget apply to each channel
+    ClipmapSet(const std::vector<std::string>& filepaths, const std::vector<textile::VTexInfo>& infos,
+        size_t io_thread_num = 0, size_t cache_budget = 0, const Config& cfg = Config());
+    ~ClipmapSet();
+
+    void Init(const ur::Device& dev);
+
+    void Update(const ur::Device& dev, ur::Context& ctx,
+        float scale, const sm::vec2& offset);
+    void GetRegion(float& scale, sm::vec2& offset) const;
+
+    void Draw(const ur::Device& dev, ur::Context& ctx, size_t channel,
+        float screen_width, float screen_height) const;
+
+    // cap on pages written per Update(), checked between page coordinates
+    // so the channels stay in step
+    void SetUploadBudget(size_t max_pages, size_t max_bytes = 0, int64_t max_us = 0) {
+        m_budget.Set(max_pages, max_bytes, max_us);
+    }
+    size_t GetPendingPages() const;
+
+    size_t GetChannelNum() const { return m_channels.size(); }
+    auto& GetStack(size_t channel) const { return *m_channels[channel].stack; }
+    auto& GetService(size_t channel) const { return m_channels[channel].service; }
+
+    // counters of all channels together
+    auto& GetStats() const { return m_stats; }
+    void ResetStats() { m_stats.Reset(); }
+
+private:
+    void WritePendingPages(const ur::Device& dev);
+    void FlushLoadedPages(const ur::Device& dev);
+
+private:
+    struct Channel
+    {
+        std::shared_ptr<PageService>  service;
+        std::unique_ptr<TextureStack> stack;
+    };
+
+    std::vector<Channel> m_channels;
+
+    sm::rect m_viewport;
+
+    // scratch of Update()
+    TextureStack::ViewDiff m_view_diff;
+
+    StatsRecorder m_stats;
+
+    UploadBudget m_budget;
+
+}; // ClipmapSet
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <unirender/TextureDescription.h>
+
+#include <vector>
+
+#include <stddef.h>
+
+namespace clipmap
+{
+
+struct Config
+{
+    // texels per side of each layer, multiple of the tile size
+    size_t ring_size = 512;
+
+    // ring layers above the mip tail, 0 for all levels. with fewer, the
+    // finest levels are dropped and the view magnifies the finest kept one
+    size_t level_num = 0;
+
+    // format of each level's layer, RGBA8 for missing entries
+    std::vector<ur::TextureFormat> formats;
+
+    // screen area of the view, no larger than ring_size
+    int viewport_width  = 512;
+    int viewport_height = 512;
+
+    ur::TextureFormat GetFormat(size_t level) const {
+        return level < formats.size() ? formats[level] : ur::TextureFormat::RGBA8;
+    }
+
+}; // Config
+
+}
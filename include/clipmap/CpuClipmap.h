@@ -0,0 +1,50 @@
+#pragma once
+
+#include "clipmap/PageStreamer.h"
+#include "clipmap/CpuTextureStack.h"
+
+#include <textile/PageIndexer.h>
+#include <textile/VTexInfo.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+
+namespace clipmap
+{
+
+// headless Clipmap, for server side rendering and perf tests
+class CpuClipmap : private boost::noncopyable
+{
+public:
+    // thread_num 0 uses all cores
+    CpuClipmap(const std::string& filepath, const textile::VTexInfo& info,
+        size_t thread_num = 0);
+
+    // false if the file could not be read, see PageStreamer::IsValid()
+    bool IsValid() const { return m_streamer.IsValid(); }
+
+    void Update(float scale, const sm::vec2& offset);
+    void GetRegion(float& scale, sm::vec2& offset) const;
+
+    // width * height * GetChannels() bytes
+    void Draw(uint8_t* dst, int width, int height) const;
+
+    size_t GetChannels() const { return m_stack.GetChannels(); }
+
+    auto& GetStack() const { return m_stack; }
+
+private:
+    textile::VTexInfo m_info;
+
+    textile::PageIndexer m_indexer;
+
+    PageStreamer m_streamer;
+
+    CpuTextureStack m_stack;
+
+    sm::rect m_viewport = sm::rect(0, 0, 512, 512);
+
+}; // CpuClipmap
+
+}
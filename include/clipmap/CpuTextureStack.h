@@ -0,0 +1,97 @@
+#pragma once
+
+#include "clipmap/RectDiff.h"
+
+#include <SM_Vector.h>
+#include <SM_Rect.h>
+#include <textile/Page.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace textile { struct VTexInfo; }
+
+namespace clipmap
+{
+
+class PageStreamer;
+
+// TextureStack without gpu, layers are rings in memory with the
+// vtex channels at 8 bits, same regions and page placement
+class CpuTextureStack : private boost::noncopyable
+{
+public:
+    struct Layer
+    {
+        Layer() {
+            region.MakeEmpty();
+        }
+
+        std::vector<uint8_t> pixels;
+        sm::rect region;
+    };
+
+    struct UpdateStats
+    {
+        size_t pages_requested = 0;
+        size_t pages_loaded    = 0;
+        size_t bytes_loaded    = 0;
+        // reads that failed twice, their pages stay blank
+        size_t pages_failed    = 0;
+        size_t blits           = 0;
+        // pages the rings dropped entirely, their slots reused
+        size_t pages_evicted   = 0;
+    };
+
+public:
+    // thread_num 0 uses all cores
+    CpuTextureStack(const textile::VTexInfo& vtex_info, size_t ring_size = 512,
+        size_t thread_num = 0);
+
+    // loads with streamer and waits for the pages, so the result is deterministic
+    void Update(PageStreamer& streamer, const sm::rect& viewport,
+        float scale, const sm::vec2& offset);
+    // resample current view, width * height * channels bytes
+    void Draw(uint8_t* dst, int width, int height) const;
+
+    // bilinear value of one channel in [0, 1], at level 0 texel coords
+    // inside the level's region, as a GeometryClipmap height sampler
+    float Sample(size_t level, float x, float y, size_t channel = 0) const;
+
+    auto& GetAllLayers() const { return m_layers; }
+    // of the last Update which moved the regions
+    auto& GetUpdateStats() const { return m_stats; }
+
+    size_t GetRingSize() const { return m_ring_size; }
+    size_t GetChannels() const;
+
+    void GetRegion(float& scale, sm::vec2& offset) const {
+        scale = m_scale;
+        offset = m_offset;
+    }
+
+private:
+    void BlitPage(const RectDiff::PageRegion& blit, const uint8_t* data);
+
+    void SampleLayer(const Layer& layer, float u, float v, uint8_t* dst) const;
+
+private:
+    const textile::VTexInfo& m_vtex_info;
+
+    size_t m_ring_size;
+    size_t m_thread_num;
+
+    std::vector<Layer> m_layers;
+
+    sm::rect m_viewport;
+    float    m_scale = 0;
+    sm::vec2 m_offset;
+
+    UpdateStats m_stats;
+
+}; // CpuTextureStack
+
+}
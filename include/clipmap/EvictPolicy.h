@@ -0,0 +1,60 @@
+#pragma once
+
+#include <textile/Page.h>
+
+#include <list>
+#include <vector>
+
+namespace clipmap
+{
+
+class TextureStack;
+
+class EvictPolicy
+{
+public:
+    // ordered from most to least recently used
+    typedef std::list<textile::Page> PageList;
+
+public:
+    virtual ~EvictPolicy() {}
+
+    // choose the page to drop, lru is never empty
+    virtual PageList::const_iterator
+        SelectVictim(const PageList& lru) const = 0;
+
+}; // EvictPolicy
+
+class LRUEvictPolicy : public EvictPolicy
+{
+public:
+    virtual PageList::const_iterator
+        SelectVictim(const PageList& lru) const override;
+
+}; // LRUEvictPolicy
+
+// keeps the coarse levels every frame falls back on, and the pages
+// inside the current clip regions, drops the oldest of the rest
+class ClipmapEvictPolicy : public EvictPolicy
+{
+public:
+    ClipmapEvictPolicy(const TextureStack& stack, int protect_levels = 2);
+
+    // other views of a shared cache, a page is kept if any view needs it
+    void AddStack(const TextureStack& stack) { m_stacks.push_back(&stack); }
+
+    virtual PageList::const_iterator
+        SelectVictim(const PageList& lru) const override;
+
+private:
+    bool IsProtected(const textile::Page& page) const;
+    bool IsProtected(const TextureStack& stack, const textile::Page& page) const;
+
+private:
+    std::vector<const TextureStack*> m_stacks;
+
+    int m_protect_levels;
+
+}; // ClipmapEvictPolicy
+
+}
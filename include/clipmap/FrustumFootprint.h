@@ -0,0 +1,48 @@
+#pragma once
+
+#include <SM_Rect.h>
+#include <SM_Matrix.h>
+
+#include <vector>
+
+#include <stddef.h>
+
+namespace textile { struct VTexInfo; }
+
+namespace clipmap
+{
+
+// clip regions of a perspective view over the ground plane z = 0. rays
+// through a screen grid give the visible texels and the level each needs,
+// a level's region is the part of the ground that level or a finer one
+// is needed for, so the far field only loads coarse pages
+class FrustumFootprint
+{
+public:
+    struct Params
+    {
+        // level 0 texels per world unit, texel (0, 0) at the world origin
+        float texels_per_unit = 1;
+
+        // pixels, for the texel density
+        float screen_width  = 1024;
+        float screen_height = 768;
+
+        // rays per screen side
+        int grid = 32;
+
+        // added to the level of every ray, > 0 loads coarser
+        float lod_bias = 0;
+    };
+
+public:
+    // regions has all layer_num levels, those finer than the returned
+    // finest level are empty. each region fits in ring_size texels of its
+    // level and contains the finer ones
+    static size_t CalcRegions(const textile::VTexInfo& info, size_t layer_num, size_t ring_size,
+        const sm::mat4& view_proj, const Params& params, std::vector<sm::rect>& regions,
+        size_t min_level = 0);
+
+}; // FrustumFootprint
+
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <SM_Vector.h>
+#include <SM_Rect.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+#include <functional>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace clipmap
+{
+
+class TextureStack;
+class CpuTextureStack;
+
+// terrain mesh as nested vertex grid rings, one per texture stack level
+// and centered on the same regions, so heights come from the height
+// channel's layers. same triangle count for any terrain size, cpu only,
+// the vertex and index arrays are for the renderer to upload
+class GeometryClipmap : private boost::noncopyable
+{
+public:
+    struct Vertex
+    {
+        // level 0 texels
+        float x = 0, y = 0;
+
+        // from this level, and the next coarser level as its grid would
+        // interpolate it here
+        float height = 0;
+        float coarse_height = 0;
+
+        // 0 inside, up to 1 on the outer border where the vertex sits on
+        // the coarser ring's edge, so the seam has no cracks
+        float morph = 0;
+
+        float FinalHeight() const { return height + (coarse_height - height) * morph; }
+    };
+
+    struct Ring
+    {
+        size_t level = 0;
+
+        // first vertex in grid units of the level, always even so the
+        // grid lines meet those of the next coarser level
+        int origin_x = 0, origin_y = 0;
+
+        // cells left for the finer ring, relative to origin, empty for
+        // the finest ring
+        int hole_x0 = 0, hole_y0 = 0, hole_x1 = 0, hole_y1 = 0;
+
+        // grid_size * grid_size, row major, those inside the hole unused
+        std::vector<Vertex> verts;
+        // cells outside the hole, and zero area triangles along the outer
+        // border closing the t-junctions with the coarser ring
+        std::vector<uint32_t> indices;
+
+        // bumped when verts or indices change, for the upload
+        uint32_t version = 0;
+
+        // toroidal by grid coords, coarse only at even vertices
+        std::vector<float> heights;
+        std::vector<float> coarse_heights;
+        bool heights_valid = false;
+        bool has_coarser   = false;
+    };
+
+    // level, then level 0 texel coords, the height in any unit
+    typedef std::function<float(size_t level, float x, float y)> HeightSampler;
+
+public:
+    // grid_size vertices per ring side, 2^k - 1 and at least 15.
+    // texels_per_vertex in each level's own texels. keep the ring,
+    // (grid_size - 1) * texels_per_vertex, within half the viewport so
+    // it stays inside the stack regions. ring_num 0 for all levels
+    GeometryClipmap(size_t grid_size = 127, float texels_per_vertex = 1,
+        size_t ring_num = 0);
+
+    // regions of all levels as the stack layers have them, rings from
+    // start_level. only moved rings are rebuilt, and only the vertices
+    // they expose are sampled
+    void Update(const std::vector<sm::rect>& regions, size_t start_level,
+        const HeightSampler& sampler);
+    void Update(const TextureStack& stack, const HeightSampler& sampler);
+    void Update(const CpuTextureStack& stack, const HeightSampler& sampler);
+
+    // sample all heights again, such as after height pages arrived
+    void Invalidate();
+
+    auto& GetRings() const { return m_rings; }
+    size_t GetGridSize() const { return m_grid_size; }
+
+    size_t GetTriangleCount() const;
+    // by the last Update()
+    size_t GetSampleCount() const { return m_sample_count; }
+
+private:
+    void UpdateRing(Ring& ring, size_t level, const sm::vec2& center, const Ring* finer,
+        bool has_coarser, const HeightSampler& sampler);
+
+    void SampleHeights(Ring& ring, int x0, int y0, int x1, int y1, bool has_coarser,
+        const HeightSampler& sampler);
+
+    void BuildVertices(Ring& ring, bool has_coarser) const;
+    void BuildIndices(Ring& ring, bool has_coarser) const;
+
+    float Spacing(size_t level) const;
+    size_t Slot(int gx, int gy) const;
+
+private:
+    size_t m_grid_size;
+    float  m_texels_per_vertex;
+    size_t m_ring_num;
+
+    std::vector<Ring> m_rings;
+
+    size_t m_sample_count = 0;
+
+}; // GeometryClipmap
+
+}
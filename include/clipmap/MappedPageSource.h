@@ -0,0 +1,58 @@
+#pragma once
+
+#include <textile/VTexInfo.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace clipmap
+{
+
+// read-only memory mapping of a vtex file, pages are handed out as
+// pointers into the mapping without syscalls or copies, and the os page
+// cache behind it is shared with other processes
+class MappedPageSource : private boost::noncopyable
+{
+public:
+    MappedPageSource(const std::string& filepath, const textile::VTexInfo& info);
+    ~MappedPageSource();
+
+    // false if the file could not be mapped, such as in a 32 bit process,
+    // or its page index is damaged
+    bool IsOpen() const { return m_data != nullptr; }
+
+    // by page index, nullptr if out of the file
+    const uint8_t* GetPage(int idx) const;
+    size_t GetPageBytes() const { return m_page_bytes; }
+
+    // ask the os to read the page in ahead of use
+    void WillNeed(int idx) const;
+
+private:
+    void Map(const std::string& filepath);
+    void Unmap();
+
+    bool BuildIndex(const textile::VTexInfo& info);
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    void* m_file    = nullptr;
+    void* m_mapping = nullptr;
+#endif
+
+    size_t m_page_bytes = 0;
+
+    // file offset of each page by page index
+    std::vector<uint64_t> m_offsets;
+
+}; // MappedPageSource
+
+}
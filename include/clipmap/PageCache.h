@@ -1,36 +1,210 @@
 #pragma once
 
+#include "clipmap/BlockCompress.h"
+
+#include <SM_Rect.h>
 #include <unirender/typedef.h>
 #include <textile/PageCache.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+#include <functional>
+
 namespace ur { class Device; }
 
 namespace clipmap
 {
 
-class TextureStack;
+class PageStreamer;
+class MappedPageSource;
+class RamPageCache;
+class EvictPolicy;
+class StatsRecorder;
+class UploadBudget;
+struct FrameStats;
 
 class PageCache : public textile::PageCache
 {
 public:
+    struct PageSlot
+    {
+        int idx = -1;
+        // area in pool texture
+        sm::rect uv;
+
+        // one colour page, kept as the colour with no pool slot
+        // rgba8, r in the low byte
+        bool uniform = false;
+        uint32_t color = 0;
+
+        bool IsValid() const { return idx >= 0 || uniform; }
+    };
+
+public:
+    // budget_bytes 0 means room for 256 pages
 	PageCache(textile::PageLoader& loader, const textile::PageIndexer& indexer,
-        TextureStack& tex_stack);
+        size_t budget_bytes = 0);
     virtual ~PageCache();
 
+    void Init(const ur::Device& dev);
+
+    // resizing drops all resident pages, the stack layers keep their pixels
+    void SetBudget(const ur::Device& dev, size_t budget_bytes);
+    // as asked for, the pool may hold less, see GetCapacity()
+    size_t GetBudget() const { return m_req_capacity * CalcPageBytes(); }
+    // pages the pool holds, after the max pool size cap
+    size_t GetCapacity() const { return m_capacity; }
+    // bytes of one page in the pool
+    size_t GetPageBytes() const { return CalcPageBytes(); }
+    // side of the pool texture is kept within max_size, the device max
+    // texture size, so a large budget holds fewer pages instead of failing
+    void SetMaxPoolSize(const ur::Device& dev, int max_size);
+
+    // one reference per view which shows the page, referenced pages are
+    // only evicted when nothing else is left. pages need not be resident
+    void AddRef(const textile::Page& page);
+    void Release(const textile::Page& page);
+    int GetRefCount(const textile::Page& page) const;
+
+    // default is LRUEvictPolicy
+    void SetEvictPolicy(const std::shared_ptr<EvictPolicy>& policy);
+    // max resident pages of a mip level, 0 is unlimited
+    void SetMipQuota(int mip, size_t max_pages);
+
+    // keep pages block compressed in the pool, BC4/BC5/BC1/BC3 for 1-4 channels
+    // pages are encoded on the streaming workers if there are
+    void EnableCompression(const ur::Device& dev, bool enable);
+    bool IsCompressed() const { return m_compressed; }
+
 	virtual void LoadComplete(const ur::Device& dev, const textile::Page& page, const uint8_t* data) override;
 
-    ur::TexturePtr QueryPageTex(const textile::Page& page) const;
+    PageSlot QueryPageTex(const textile::Page& page) const;
+    auto& GetPoolTex() const { return m_pool_tex; }
+    // pages found to have a single colour, they take no slot
+    size_t GetUniformCount() const { return m_uniform_pages.size(); }
+
+    // false if the workers can't read the file, pages are loaded as before
+    bool EnableStreaming(const std::string& filepath, size_t thread_num);
+    bool IsStreaming() const { return m_streamer != nullptr; }
+
+    // read pages from a memory mapping of the file, on the render thread
+    // and the streaming workers, false if the file can't be mapped
+    bool EnableMapping(const std::string& filepath);
+    bool IsMapped() const { return m_mapping != nullptr; }
+
+    // keep pages read from the file lz4 compressed in ram, so pages the
+    // pool evicted come back without io. 0 to disable, unused if mapped
+    void EnableRamCache(size_t budget_bytes);
+    auto& GetRamCache() const { return m_ram_cache; }
+
+    // load page right away, or only queue it when streaming
+    // return true if page is resident
+    bool Fetch(const ur::Device& dev, const textile::Page& page);
+    // upload pages the streaming workers have finished, stops when the
+    // budget is used up or after max_num pages, 0 is no limit, and leaves
+    // the rest to later calls. returns the number of pages taken
+    size_t Flush(const ur::Device& dev, std::function<void(const textile::Page& page)> cb,
+        UploadBudget* budget = nullptr, size_t max_num = 0);
+
+    // low priority load, only when streaming
+    void Prefetch(const textile::Page& page);
+    void CancelPrefetch();
+    void SetPrefetchBudget(size_t budget);
+
+    // max visible pages queued or loading on the streaming workers, the
+    // stacks hold back the rest, 0 is unlimited. default 4 per worker
+    // queued pages which left every view are dropped in Flush()
+    void SetMaxLoadsInFlight(size_t max_num);
+    bool IsLoadQueueFull() const;
+
+    // counters go to the current frame of stats, nullptr to disable
+    void SetStats(StatsRecorder* stats) { m_stats = stats; }
 
 private:
-    ur::TexturePtr CreatePageTex(const ur::Device& dev, const uint8_t* data) const;
+    struct Entry
+    {
+        int slot = -1;
+        std::list<textile::Page>::iterator lru_itr;
+    };
+
+    void InsertPage(const ur::Device& dev, const textile::Page& page,
+        const uint8_t* data, bool encoded);
+    std::list<textile::Page>::const_iterator SelectVictim() const;
+    void Evict(std::list<textile::Page>::const_iterator itr);
+    void ClearPool();
+
+    void UploadPage(int slot, const uint8_t* data, bool encoded);
+
+    // false if the page has more than one colour
+    bool CalcUniformColor(const uint8_t* data, bool encoded, uint32_t& color) const;
+
+    // to 8-bit and pool channel layout, returns data if nothing to do
+    const uint8_t* ConvertPage(const uint8_t* data, uint8_t* narrow_buf,
+        uint8_t* page_buf) const;
+    void EncodePage(const uint8_t* data, uint8_t* narrow_buf, uint8_t* page_buf,
+        uint8_t* dst) const;
+    void ResetTranscoder();
+
+    PageSlot CalcSlot(int slot) const;
+
+    // streamed reads of the page failed past the retries
+    bool IsReadGivenUp(int idx) const;
+
+    size_t CalcPageBytes() const;
+
+    FrameStats* CurrStats() const;
 
 private:
     const textile::PageIndexer& m_indexer;
-    TextureStack& m_tex_stack;
 
-    std::unordered_map<int, ur::TexturePtr> m_map_page2tex;
+    // physical pages, m_capacity slots in a pool_n * pool_n grid
+    ur::TexturePtr m_pool_tex = nullptr;
+    // pages the budget buys, kept so a raised max pool size can use them
+    size_t m_req_capacity = 0;
+    size_t m_capacity = 0;
+    size_t m_pool_n = 0;
+    // texels, the minimum max texture size of gl 4.1 and d3d 11
+    int m_max_pool_size = 16384;
+
+    std::vector<int> m_free_slots;
+
+    // front is most recently used
+    std::list<textile::Page> m_lru_list;
+    std::unordered_map<int, Entry> m_map_page2entry;
+
+    // page idx to colour, a few bytes each so never evicted
+    std::unordered_map<int, uint32_t> m_uniform_pages;
+
+    // page idx to view count
+    std::unordered_map<int, int> m_page_refs;
+
+    // page idx to failed reads in a row, kept past the retries so the
+    // page is not read again
+    std::unordered_map<int, int> m_read_failures;
+
+    std::shared_ptr<EvictPolicy> m_evict_policy = nullptr;
+
+    std::vector<size_t> m_mip_quota;
+    std::vector<size_t> m_mip_count;
+
+    // conversion scratch, only allocated if the page layout needs it
+    uint8_t* m_page_buf   = nullptr;
+    uint8_t* m_narrow_buf = nullptr;
+
+    bool m_compressed = false;
+    BlockCompress::Format m_block_fmt = BlockCompress::Format::BC1;
+    std::vector<uint8_t> m_block_buf;
+
+    std::unique_ptr<PageStreamer> m_streamer;
+
+    std::shared_ptr<MappedPageSource> m_mapping = nullptr;
+
+    std::shared_ptr<RamPageCache> m_ram_cache = nullptr;
+    std::vector<uint8_t> m_ram_buf;
 
-    uint8_t* m_page_buf = nullptr;
+    StatsRecorder* m_stats = nullptr;
 
 }; // PageCache
 
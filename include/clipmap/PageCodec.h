@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace clipmap
+{
+
+// lz4 block format, byte aligned lz77 with a 64k window, fast enough to
+// run per page on the loading path
+class PageCodec
+{
+public:
+    // max compressed size of src_size bytes
+    static size_t CalcBound(size_t src_size);
+
+    // dst holds CalcBound(src_size), returns the compressed size
+    static size_t Compress(const uint8_t* src, size_t src_size, uint8_t* dst);
+    // false if src is corrupt or does not give exactly dst_size bytes
+    static bool Decompress(const uint8_t* src, size_t src_size,
+        uint8_t* dst, size_t dst_size);
+
+}; // PageCodec
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <textile/VTexInfo.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace clipmap
+{
+
+// page layout of vtex files. plain files end with the pages in page index
+// order. packed files, from tools/vtex_pack, have each level's pages in
+// Morton order so neighbours are close on disk, then the file offset of
+// every page by page index and a Footer. packed files are only read by
+// PageStreamer and MappedPageSource, not by textile::PageLoader, so
+// PageService maps or streams them even if asked for neither
+class PageFile
+{
+public:
+    static const uint32_t MAGIC   = 0x4b504d43; // "CMPK"
+    static const uint32_t VERSION = 1;
+
+    struct Footer
+    {
+        uint32_t magic   = MAGIC;
+        uint32_t version = VERSION;
+
+        uint64_t index_offset = 0;
+        uint64_t page_count   = 0;
+
+        uint32_t vtex_width  = 0;
+        uint32_t vtex_height = 0;
+        uint32_t tile_size   = 0;
+        uint32_t channels    = 0;
+        uint32_t bytes       = 0;
+        uint32_t padding     = 0;
+    };
+
+public:
+    // reads size bytes at offset of the file, false if out of the file
+    typedef std::function<bool(uint64_t offset, size_t size, void* dst)> ReadAt;
+
+    // file offset of each page by page index, false if the file is too
+    // small or a packed file does not match info
+    static bool BuildIndex(size_t file_size, const textile::VTexInfo& info,
+        const ReadAt& read_at, std::vector<uint64_t>& offsets);
+
+    // true if the file ends with a footer
+    static bool IsPacked(const std::string& filepath);
+
+    // footer of a packed file, false for plain files
+    static bool ReadFooter(const uint8_t* tail, size_t file_size, Footer& footer);
+    static void InitFooter(const textile::VTexInfo& info, uint64_t index_offset, Footer& footer);
+
+    // interleaved bits, x in the even ones
+    static uint64_t MortonCode(uint32_t x, uint32_t y);
+
+    // Morton rank of each page inside its level, by page index
+    static void CalcPackedOrder(const textile::VTexInfo& info, std::vector<uint64_t>& ranks);
+
+    static size_t CalcPageBytes(const textile::VTexInfo& info) {
+        return info.tile_size * info.tile_size * info.channels * info.bytes;
+    }
+
+}; // PageFile
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "clipmap/PageCache.h"
+
+#include <textile/PageIndexer.h>
+#include <textile/PageLoader.h>
+#include <textile/VTexInfo.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+namespace ur { class Device; }
+
+namespace clipmap
+{
+
+class TextureStack;
+class UploadBudget;
+
+// one file and one page pool for several views of the same texture, a
+// page is loaded once and kept while any view shows it
+class PageService : private boost::noncopyable
+{
+public:
+    // io_thread_num > 0 streams pages on background workers
+    // cache_budget is in bytes, 0 for the default 256 pages
+    PageService(const std::string& filepath, const textile::VTexInfo& info,
+        size_t io_thread_num = 0, size_t cache_budget = 0);
+
+    void Init(const ur::Device& dev);
+
+    // false if no reader could open the file, such as a packed file with
+    // a damaged index, no page is loaded then
+    bool IsValid() const { return m_valid; }
+
+    // pages straight from a memory mapping of the file, false if it
+    // can't be mapped and reads go on as before
+    bool EnableMapping() { return m_cache.EnableMapping(m_filepath); }
+
+    // views get the pages any view has loaded
+    void AddView(TextureStack& stack);
+    // drops the view's page references
+    void RemoveView(TextureStack& stack);
+    size_t GetViewCount() const { return m_views.size(); }
+
+    // upload pages the streaming workers have finished, and queue them to
+    // every view which shows them. at most max_num pages, 0 is no limit,
+    // returns the number taken
+    size_t Flush(const ur::Device& dev, UploadBudget* budget = nullptr, size_t max_num = 0);
+
+    auto& GetVTexInfo() const { return m_info; }
+    auto& GetCache() { return m_cache; }
+    auto& GetCache() const { return m_cache; }
+
+private:
+    std::string m_filepath;
+
+    textile::VTexInfo m_info;
+
+    textile::PageIndexer m_indexer;
+    textile::PageLoader  m_loader;
+
+    PageCache m_cache;
+
+    std::vector<TextureStack*> m_views;
+
+    bool m_valid = true;
+
+}; // PageService
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <textile/Page.h>
+#include <textile/VTexInfo.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <iosfwd>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+namespace textile { class PageIndexer; }
+
+namespace clipmap
+{
+
+class MappedPageSource;
+class RamPageCache;
+
+class PageStreamer : private boost::noncopyable
+{
+public:
+    PageStreamer(const std::string& filepath, const textile::VTexInfo& info,
+        const textile::PageIndexer& indexer, size_t thread_num);
+    ~PageStreamer();
+
+    // false if the file could not be opened or its page index is damaged,
+    // every read fails then
+    bool IsValid() const { return !m_offsets.empty(); }
+
+    // queue page for the workers, false if it is already in flight
+    // prefetch pages only run when no visible page is waiting, visible
+    // pages run coarse levels first and in submit order within a level
+    bool Submit(const textile::Page& page, bool prefetch = false);
+    // drop queued prefetch pages which are not started yet
+    void CancelPrefetch();
+    // max queued + running prefetch pages
+    void SetPrefetchBudget(size_t budget) { m_prefetch_budget = budget; }
+
+    // drop queued visible pages which are not started yet and no longer
+    // wanted, returns the number dropped
+    size_t Cancel(std::function<bool(const textile::Page& page)> is_stale);
+    // max queued + running visible pages before IsFull(), 0 is unlimited
+    // callers keep the rest and submit them in their latest order later
+    void SetMaxInFlight(size_t max_num);
+    bool IsFull() const;
+
+    // convert pages on the workers before they are handed over, such as
+    // block compression, nullptr to hand over the file data
+    typedef std::function<void(const uint8_t* src, std::vector<uint8_t>& dst)> Transcoder;
+    void SetTranscoder(const Transcoder& transcoder);
+
+    // hand over pages as pointers into the mapping instead of reading
+    // them into buffers, prefetched pages are hinted to the os at submit
+    // nullptr to read the file
+    void SetPageSource(const std::shared_ptr<MappedPageSource>& source);
+    // looked up before reading the file, filled with what was read
+    void SetRamCache(const std::shared_ptr<RamPageCache>& cache);
+
+    // transcoded tells if the data went through the transcoder, which
+    // may have been swapped since the page was picked up
+    typedef std::function<void(const textile::Page& page, const uint8_t* data, bool transcoded)> Callback;
+
+    // pages whose read failed, they are out of flight once Poll() returns
+    // and can be submitted again then
+    typedef std::function<void(const textile::Page& page)> FailCallback;
+
+    // call on render thread, hands over pages finished since last poll
+    // at most max_num of them if not 0, returns the number handed over
+    // failed pages count too, they go to on_fail instead of cb
+    size_t Poll(Callback cb, size_t max_num = 0, FailCallback on_fail = nullptr);
+    // block until every submitted page is handed over
+    void Drain(Callback cb, FailCallback on_fail = nullptr);
+
+    bool IsPending(const textile::Page& page) const;
+
+    // pages of all mip levels
+    static size_t CalcPageCount(const textile::VTexInfo& info);
+
+private:
+    struct Request
+    {
+        textile::Page page;
+        int idx = 0;
+    };
+
+    struct Result
+    {
+        textile::Page page;
+        int idx = 0;
+        std::vector<uint8_t> data;
+        // into the mapping, instead of data
+        const uint8_t* mapped = nullptr;
+        std::shared_ptr<MappedPageSource> source = nullptr;
+        bool succ = false;
+        bool prefetch = false;
+        bool transcoded = false;
+    };
+
+    // with m_mutex held
+    void PushRequest(const Request& req);
+    bool CanStartPrefetch() const;
+
+    void WorkerLoop();
+
+    bool ReadPage(std::ifstream& fin, int idx, uint8_t* dst) const;
+
+private:
+    std::string m_filepath;
+
+    const textile::VTexInfo& m_info;
+    const textile::PageIndexer& m_indexer;
+
+    size_t m_page_bytes = 0;
+
+    // file offset of each page by page index, see PageFile
+    std::vector<uint64_t> m_offsets;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_done_cond;
+
+    std::deque<Request> m_requests;
+    std::deque<Request> m_prefetch_requests;
+    size_t m_prefetch_running = 0;
+    size_t m_prefetch_budget  = 32;
+    size_t m_visible_running  = 0;
+    size_t m_max_in_flight    = 0;
+    std::vector<Result> m_completed;
+    std::unordered_set<int> m_pending;
+
+    std::vector<std::vector<uint8_t>> m_free_bufs;
+
+    Transcoder m_transcoder = nullptr;
+
+    std::shared_ptr<MappedPageSource> m_source = nullptr;
+    std::shared_ptr<RamPageCache> m_ram_cache = nullptr;
+
+    std::vector<std::thread> m_threads;
+    bool m_stop = false;
+
+}; // PageStreamer
+
+}
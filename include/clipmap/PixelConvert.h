@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace clipmap
+{
+
+// page ingest kernels, SSE2 on x86 targets, SSSE3 and AVX2 picked at
+// runtime from the cpu
+class PixelConvert
+{
+public:
+    // fill alpha with 0xff
+    static void RGB2RGBA(const uint8_t* src, uint8_t* dst, size_t pixel_count);
+
+    // keep the high byte of each 16-bit component
+    static void U16ToU8(const uint16_t* src, uint8_t* dst, size_t count);
+
+    // every unit_bytes element of data equals the first, such as pixels or
+    // compressed blocks
+    static bool IsUniform(const uint8_t* data, size_t size, size_t unit_bytes);
+
+    // 2x2 box filter of two rows into one, dst_pixels is half the row
+    static void Downsample2x2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst,
+        size_t dst_pixels, int channels);
+    static void Downsample2x2(const uint16_t* row0, const uint16_t* row1, uint16_t* dst,
+        size_t dst_pixels, int channels);
+
+}; // PixelConvert
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace clipmap
+{
+
+// second tier behind the gpu page pool, file pages kept lz4 compressed in
+// ram under their own budget. looked up before any file read, so panning
+// back is decompression instead of io. safe to use from the workers
+class RamPageCache : private boost::noncopyable
+{
+public:
+    struct Stats
+    {
+        size_t hits   = 0;
+        size_t misses = 0;
+        size_t inserts   = 0;
+        size_t evictions = 0;
+
+        // of the pages held now
+        size_t raw_bytes    = 0;
+        size_t stored_bytes = 0;
+    };
+
+public:
+    // budget_bytes is of compressed data
+    RamPageCache(size_t page_bytes, size_t budget_bytes);
+
+    // copy of the page into dst, page_bytes long, false on a miss
+    bool Lookup(int idx, uint8_t* dst);
+    // replaces nothing if idx is there already
+    void Insert(int idx, const uint8_t* data);
+
+    void SetBudget(size_t budget_bytes);
+    size_t GetBudget() const { return m_budget; }
+
+    Stats GetStats() const;
+    void ResetStats();
+
+private:
+    struct Entry
+    {
+        // shared with lookups decompressing outside the lock
+        std::shared_ptr<const std::vector<uint8_t>> data;
+        // stored as is, it did not compress
+        bool raw = false;
+
+        std::list<int>::iterator lru_itr;
+    };
+
+    void EvictOverBudget();
+
+private:
+    const size_t m_page_bytes;
+    size_t m_budget;
+
+    mutable std::mutex m_mutex;
+
+    // front is most recently used
+    std::list<int> m_lru_list;
+    std::unordered_map<int, Entry> m_map_page2entry;
+
+    Stats m_stats;
+
+}; // RamPageCache
+
+}
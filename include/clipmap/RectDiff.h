@@ -0,0 +1,67 @@
+#pragma once
+
+#include <SM_Rect.h>
+#include <textile/Page.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace textile { struct VTexInfo; }
+
+namespace clipmap
+{
+
+// pages a moving clip region exposes, new region minus old one
+class RectDiff
+{
+public:
+    struct PageRegion
+    {
+        textile::Page page;
+        // part of the page to write, in level 0 texels
+        sm::rect      region;
+    };
+
+    // sorted by mip, y, x, each page once
+    typedef std::vector<PageRegion> PageSet;
+
+public:
+    // unique for pages with x, y below 2^24
+    static uint64_t PageKey(const textile::Page& page) {
+        return (static_cast<uint64_t>(page.mip) << 48)
+             | (static_cast<uint64_t>(page.y & 0xffffff) << 24)
+             | static_cast<uint64_t>(page.x & 0xffffff);
+    }
+    // pages with x, y >= 0
+    static textile::Page KeyToPage(uint64_t key) {
+        return textile::Page(static_cast<int>(key & 0xffffff), static_cast<int>((key >> 24) & 0xffffff),
+            static_cast<int>(key >> 48));
+    }
+
+    // a - b as up to 4 disjoint rects, returns the count
+    static int Subtract(const sm::rect& a, const sm::rect& b, sm::rect out[4]);
+
+    // pages of one layer touched by new_r - old_r, clamped to the texture
+    // appends to pages
+    static void CalcDiffPages(const textile::VTexInfo& info, const sm::rect& old_r,
+        const sm::rect& new_r, size_t layer, PageSet& pages);
+    // all layers from start_layer, old_regions has all layers
+    static void CalcDiffPages(const textile::VTexInfo& info, const std::vector<sm::rect>& old_regions,
+        const std::vector<sm::rect>& regions, size_t start_layer, PageSet& pages);
+
+    // visitor(const textile::Page& page, const sm::rect& region)
+    template <typename Visitor>
+    static void TraverseDiffPages(const textile::VTexInfo& info, const std::vector<sm::rect>& old_regions,
+        const std::vector<sm::rect>& regions, size_t start_layer, Visitor&& visitor)
+    {
+        PageSet pages;
+        CalcDiffPages(info, old_regions, regions, start_layer, pages);
+        for (auto& p : pages) {
+            visitor(p.page, p.region);
+        }
+    }
+
+}; // RectDiff
+
+}
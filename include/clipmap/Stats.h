@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <chrono>
+
+// set to 0 to compile the counters out
+#ifndef CLIPMAP_STATS
+#define CLIPMAP_STATS 1
+#endif
+
+#if CLIPMAP_STATS
+#define CLIPMAP_STAT_ADD(stats, field, n) do { if (stats) { (stats)->field += (n); } } while (0)
+#define CLIPMAP_STAT_TIMER_CAT(a, b) a##b
+#define CLIPMAP_STAT_TIMER_NAME(line) CLIPMAP_STAT_TIMER_CAT(_stat_timer_, line)
+#define CLIPMAP_STAT_TIMER(stats, field) \
+    clipmap::ScopedTimer CLIPMAP_STAT_TIMER_NAME(__LINE__)((stats) ? &(stats)->field : nullptr)
+#else
+// n is not evaluated, but counts as used
+#define CLIPMAP_STAT_ADD(stats, field, n) ((void)(stats), (void)sizeof(n))
+#define CLIPMAP_STAT_TIMER(stats, field) ((void)(stats))
+#endif
+
+namespace clipmap
+{
+
+struct FrameStats
+{
+    static const size_t MAX_LAYERS = 16;
+
+    // PageCache::Fetch()
+    size_t cache_hits   = 0;
+    size_t cache_misses = 0;
+    size_t evictions    = 0;
+
+    size_t pages_requested = 0;
+    // queued loads dropped after their pages left the views
+    size_t pages_cancelled = 0;
+    // loads whose read failed more often than the cache retries them
+    size_t pages_failed    = 0;
+    size_t pages_uploaded  = 0;
+    // single colour pages, kept as a colour instead of uploaded
+    size_t pages_uniform   = 0;
+    // in the pool format, after rgb expansion or block compression
+    size_t bytes_uploaded  = 0;
+    // of the same pages as stored in the file
+    size_t bytes_source    = 0;
+
+    // pages from the region diff, per layer
+    std::array<size_t, MAX_LAYERS> strips = {};
+
+    size_t draw_calls = 0;
+
+    // ms, load is fetching and uploading pages, copy is writing
+    // them into the layers, draw is the final pass
+    float load_ms = 0;
+    float copy_ms = 0;
+    float draw_ms = 0;
+
+    size_t TotalStrips() const;
+    float TotalMs() const { return load_ms + copy_ms + draw_ms; }
+
+    FrameStats& operator += (const FrameStats& stats);
+
+}; // FrameStats
+
+// current frame, cumulative totals and the last frames
+class StatsRecorder
+{
+public:
+    StatsRecorder(size_t history_size = 120);
+
+    // close the previous frame if there is one, start a new one
+    void BeginFrame();
+
+    FrameStats* GetCurrFrame() { return &m_curr; }
+    const FrameStats& GetCurrFrame() const { return m_curr; }
+    // last closed frame
+    const FrameStats& GetLastFrame() const;
+    const FrameStats& GetTotal() const { return m_total; }
+    size_t GetFrameCount() const { return m_frame_count; }
+
+    // 0 is the oldest
+    size_t GetHistorySize() const;
+    const FrameStats& GetHistory(size_t idx) const;
+
+    void Reset();
+
+private:
+    FrameStats m_curr;
+    FrameStats m_total;
+
+    // ring buffer
+    std::vector<FrameStats> m_history;
+    size_t m_history_head = 0;
+
+    size_t m_frame_count = 0;
+    bool   m_frame_open  = false;
+
+}; // StatsRecorder
+
+// add elapsed ms to dst when leaving the scope
+class ScopedTimer
+{
+public:
+    ScopedTimer(float* dst)
+        : m_dst(dst)
+    {
+        if (m_dst) {
+            m_begin = std::chrono::steady_clock::now();
+        }
+    }
+    ~ScopedTimer()
+    {
+        if (m_dst) {
+            auto end = std::chrono::steady_clock::now();
+            *m_dst += std::chrono::duration<float, std::milli>(end - m_begin).count();
+        }
+    }
+
+private:
+    float* m_dst;
+    std::chrono::steady_clock::time_point m_begin;
+
+}; // ScopedTimer
+
+}
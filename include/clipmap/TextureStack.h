@@ -1,11 +1,17 @@
 #pragma once
 
+#include "clipmap/RectDiff.h"
+#include "clipmap/Config.h"
+#include "clipmap/PageCache.h"
+
 #include <SM_Vector.h>
 #include <SM_Rect.h>
 #include <unirender/typedef.h>
+#include <textile/Page.h>
 
 #include <vector>
-#include <functional>
+#include <unordered_set>
+#include <unordered_map>
 
 namespace ur {
     class Device;
@@ -13,13 +19,17 @@ namespace ur {
     struct RenderState;
     class ShaderProgram;
     class Framebuffer;
+    class VertexArray;
 }
-namespace textile { struct Page; struct VTexInfo; }
+namespace textile { struct VTexInfo; }
+namespace tess { class Painter; }
 
 namespace clipmap
 {
 
-class PageCache;
+class StatsRecorder;
+struct FrameStats;
+class UploadBudget;
 
 class TextureStack
 {
@@ -32,57 +42,214 @@ public:
 
         ur::TexturePtr tex = nullptr;
         sm::rect region;
+
+        // keys of the written pages of the region. two pages of a region
+        // can share a ring slot, each on its own part of the slot
+        std::unordered_set<uint64_t> resident;
+
+        // one texel per page slot of the ring, 255 if every page of the
+        // region in the slot is written
+        std::vector<uint8_t> residency;
+        ur::TexturePtr residency_tex = nullptr;
+        bool residency_dirty = false;
+    };
+
+    // coarse levels small enough to fit in one layer, packed into one
+    // texture, loaded once and never diffed
+    struct MipTail
+    {
+        ur::TexturePtr tex = nullptr;
+        int width = 0, height = 0;
+
+        size_t first_level = 0;
+        // area of each level from first_level, in texels of tex
+        std::vector<sm::rect> rects;
+
+        size_t page_count = 0;
+        std::unordered_set<uint64_t> written;
+
+        bool IsLoaded() const { return written.size() == page_count; }
+    };
+
+    // regions and pages a view change exposes, stacks with the same
+    // layout and config can share one
+    struct ViewDiff
+    {
+        sm::rect viewport;
+        float    scale = 0;
+        sm::vec2 offset;
+
+        std::vector<sm::rect> regions;
+        size_t mipmap_level = 0;
+        RectDiff::PageSet pages;
     };
 
 public:
-    TextureStack(const textile::VTexInfo& vtex_info);
+    TextureStack(const textile::VTexInfo& vtex_info, const Config& cfg = Config());
 
     void Init(const ur::Device& dev);
 
+    // only layers whose size or format changed are reallocated and
+    // reloaded, the others keep their pixels
+    void SetConfig(const ur::Device& dev, const Config& cfg);
+    auto& GetConfig() const { return m_cfg; }
+
+    // pages over budget stay queued and are written by later calls, coarse
+    // levels first, call every frame even if the view has not moved
     void Update(const ur::Device& dev, ur::Context& ctx,
         PageCache& cache, const sm::rect& viewport,
-        float scale, const sm::vec2& offset);
+        float scale, const sm::vec2& offset, UploadBudget* budget = nullptr);
+    // regions of every layer, such as from FrustumFootprint, those finer
+    // than mipmap_level are ignored
+    void Update(const ur::Device& dev, ur::Context& ctx,
+        PageCache& cache, const std::vector<sm::rect>& regions,
+        size_t mipmap_level, UploadBudget* budget = nullptr);
     void Draw(const ur::Device& dev, ur::Context& ctx,
         float screen_width, float screen_height) const;
+
+    // the steps of Update(), for driving several stacks from one diff
+    bool IsViewChanged(const sm::rect& viewport, float scale, const sm::vec2& offset) const;
+    void CalcViewDiff(const sm::rect& viewport, float scale, const sm::vec2& offset,
+        ViewDiff& diff) const;
+    bool IsViewChanged(const std::vector<sm::rect>& regions, size_t mipmap_level) const;
+    // viewport, scale and offset of the diff are the finest region's
+    void CalcViewDiff(const std::vector<sm::rect>& regions, size_t mipmap_level,
+        ViewDiff& diff) const;
+    void ApplyViewDiff(PageCache& cache, const ViewDiff& diff);
+    // false if nothing is queued
+    bool WriteNextPendingPage(const ur::Device& dev, PageCache& cache, UploadBudget* budget);
+    // copy the resident tail pages, until GetMipTail().IsLoaded()
+    void LoadMipTail(const ur::Device& dev, PageCache& cache);
+    // also plots the frame history of stats if set
     void DebugDraw(const ur::Device& dev, ur::Context& ctx) const;
 
+    // queue page arrived after its strip was traversed, one colour pages
+    // are filled instead of copied from the pool
+    void AddLoadedPage(const textile::Page& page, const PageCache::PageSlot& slot);
+    // write all queued pages from the page pool, one draw per layer
+    // pages evicted since they were queued are queued again
+    void FlushPages(const ur::Device& dev, ur::Context& ctx, const PageCache& cache);
+
+    // drop the references to the pages of the regions, before the stack
+    // stops using the cache
+    void ReleasePageRefs(PageCache& cache);
+
+    // request the pages a future view would expose, at prefetch priority
+    void Prefetch(PageCache& cache, const sm::rect& viewport,
+        float scale, const sm::vec2& offset) const;
+
+    // ring layers only, the levels from GetMipTail().first_level are in the
+    // tail, layers below GetMinLevel() have no texture
     auto& GetAllLayers() const { return m_layers; }
+    size_t GetMinLevel() const { return m_min_level; }
+    auto& GetMipTail() const { return m_tail; }
+    size_t GetLevelNum() const { return m_level_num; }
 
     size_t GetTextureSize() const;
 
+    // counters go to the current frame of stats, nullptr to disable
+    void SetStats(StatsRecorder* stats) { m_stats = stats; }
+
+    // page overlaps its layer's current clip region
+    bool IsPageInRegion(const textile::Page& page) const;
+    // page has been written to its layer
+    bool IsPageResident(const textile::Page& page) const;
+
+    // pages of the regions waiting for the upload budget or a free load
+    size_t GetPendingCount() const { return m_pending.size(); }
+
     void GetRegion(float& scale, sm::vec2& offset) const {
         scale = m_scale;
         offset = m_offset;
     }
 
-    static sm::rect CalcUVRegion(int level, const Layer& layer);
-    static size_t CalcMipmapLevel(int level_num, float scale);
+    static sm::rect CalcUVRegion(int level, const Layer& layer, size_t ring_size);
+    static size_t CalcMipmapLevel(int level_num, float scale, size_t min_level = 0);
+
+    // backend independent, shared with CpuTextureStack
+
+    // toroidal slot of page inside the layer ring
+    static int WrapPageSlot(int page, int tile_n);
+
+    // clamp view to the texture, return the finest level
+    static size_t CalcRegions(const textile::VTexInfo& info, size_t layer_num,
+        const sm::rect& viewport, float& scale, sm::vec2& offset,
+        std::vector<sm::rect>& regions, size_t min_level = 0);
 
 private:
-    void AddPage(const ur::Device& dev, ur::Context& ctx, const textile::Page& page,
-        const ur::TexturePtr& tex, const sm::rect& region);
+    struct PageDraw
+    {
+        textile::Page page;
+        PageCache::PageSlot slot;
+        sm::rect      region;
+    };
+
+    void AddPage(const textile::Page& page, const PageCache::PageSlot& slot,
+        const sm::rect& region);
+    void BuildPageQuad(const PageDraw& draw, std::vector<float>& verts) const;
 
     void DrawTexture(const ur::Device& dev, ur::Context& ctx, const ur::RenderState& rs,
         float screen_width, float screen_height) const;
     void DrawDebug(const ur::Device& dev, ur::Context& ctx, const ur::RenderState& rs) const;
+    void DrawStatsPlot(tess::Painter& pt) const;
+
+    std::vector<sm::rect> GetLayerRegions() const;
+
+    void InitLevels();
+    void InitMipTail();
+    void AllocLayer(const ur::Device& dev, size_t level);
+    void AllocMipTail(const ur::Device& dev);
 
-    void TraverseDiffPages(const std::vector<sm::rect>& regions, size_t start_layer,
-        std::function<void(const textile::Page& page, const sm::rect& region)> cb);
-    void TraversePages(const sm::rect& region, size_t start_layer,
-        std::function<void(const textile::Page& page, const sm::rect& region)> cb);
+    void UpdatePageRefs(PageCache& cache);
+
+    void QueuePages(const RectDiff::PageSet& pages);
+    void WritePendingPages(const ur::Device& dev, PageCache& cache, UploadBudget* budget);
+
+    void SetPageResident(const textile::Page& page, bool resident);
+    void UploadResidency();
+    // finest layer from start with all pages of the view resident
+    size_t CalcFallbackLayer(size_t start_layer) const;
+
+    FrameStats* CurrStats() const;
 
 private:
     const textile::VTexInfo& m_vtex_info;
 
+    Config m_cfg;
+
+    size_t m_level_num = 0;
+    size_t m_min_level = 0;
+
     std::vector<Layer> m_layers;
+    MipTail m_tail;
 
     std::shared_ptr<ur::Framebuffer> m_fbo = nullptr;
     std::shared_ptr<ur::ShaderProgram> m_update_shader = nullptr;
+    std::shared_ptr<ur::VertexArray>   m_update_va     = nullptr;
+    int m_update_vbuf_sz = 0;
+    int m_page_map_slot  = 0;
     mutable std::shared_ptr<ur::ShaderProgram> m_final_shader = nullptr;
 
+    std::vector<PageDraw> m_page_draws;
+
+    // scratch of Update()
+    ViewDiff m_view_diff;
+
+    // highest priority at the back
+    std::vector<textile::Page> m_pending;
+    std::unordered_set<uint64_t> m_pending_keys;
+
+    // pages of the regions referenced in the cache, sorted by key
+    std::vector<textile::Page> m_ref_pages;
+    // tail pages still streaming, also referenced
+    std::unordered_map<uint64_t, textile::Page> m_tail_refs;
+
+    sm::rect m_viewport;
     float    m_scale = 0;
     sm::vec2 m_offset;
 
+    StatsRecorder* m_stats = nullptr;
+
 }; // TextureStack
 
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <textile/VTexInfo.h>
+
+#include <string>
+#include <iosfwd>
+
+namespace ur { class Device; class Context; }
+
+namespace clipmap
+{
+
+class Clipmap;
+class CpuClipmap;
+class CameraTrace;
+
+// replay camera traces through a clipmap and measure them
+class TraceReplay
+{
+public:
+    struct Report
+    {
+        size_t frame_num = 0;
+
+        // Update() time in ms
+        float latency_mean = 0;
+        float latency_p50  = 0;
+        float latency_p90  = 0;
+        float latency_p99  = 0;
+        float latency_max  = 0;
+
+        // totals over all frames
+        size_t pages_requested = 0;
+        size_t pages_loaded    = 0;
+        size_t bytes_loaded    = 0;
+        size_t blits           = 0;
+        size_t pages_evicted   = 0;
+
+        // gpu Clipmap only, from its frame stats
+        bool   gpu            = false;
+        size_t cache_hits     = 0;
+        size_t cache_misses   = 0;
+        size_t bytes_uploaded = 0;
+        size_t draw_calls     = 0;
+    };
+
+public:
+    // page file in the layout PageStreamer reads, every page gets a
+    // pattern from its position so the output can be eyeballed
+    static bool WriteSyntheticVTex(const std::string& filepath,
+        const textile::VTexInfo& info);
+
+    static Report Run(CpuClipmap& clipmap, const CameraTrace& trace);
+    // the device can be a null one, the cache, upload budget and stats
+    // run the same
+    static Report Run(Clipmap& clipmap, const ur::Device& dev,
+        ur::Context& ctx, const CameraTrace& trace);
+
+    static void Print(std::ostream& os, const std::string& name,
+        const Report& report);
+
+}; // TraceReplay
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace clipmap
+{
+
+// per frame limit of pages written to the stack, 0 is unlimited
+class UploadBudget
+{
+public:
+    void Set(size_t max_pages, size_t max_bytes, int64_t max_us);
+
+    void BeginFrame();
+
+    // bytes uploaded to the page pool, 0 for a cache hit
+    void Consume(size_t bytes);
+
+    bool IsExhausted() const;
+    bool IsUnlimited() const {
+        return m_max_pages == 0 && m_max_bytes == 0 && m_max_us == 0;
+    }
+
+    size_t GetPages() const { return m_pages; }
+    size_t GetBytes() const { return m_bytes; }
+
+private:
+    size_t  m_max_pages = 0;
+    size_t  m_max_bytes = 0;
+    int64_t m_max_us    = 0;
+
+    size_t m_pages = 0;
+    size_t m_bytes = 0;
+    std::chrono::steady_clock::time_point m_begin;
+
+}; // UploadBudget
+
+}
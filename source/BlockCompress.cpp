@@ -0,0 +1,340 @@
+#include "clipmap/BlockCompress.h"
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+
+uint16_t pack_565(int r, int g, int b)
+{
+    return static_cast<uint16_t>(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+void unpack_565(uint16_t c, int* rgb)
+{
+    const int r = (c >> 11) & 0x1f;
+    const int g = (c >> 5) & 0x3f;
+    const int b = c & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// block: 16 pixels, 4 bytes each
+void encode_color_block(const uint8_t* block, uint8_t* dst)
+{
+    int min_c[3] = { 255, 255, 255 };
+    int max_c[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            min_c[c] = std::min(min_c[c], static_cast<int>(block[i * 4 + c]));
+            max_c[c] = std::max(max_c[c], static_cast<int>(block[i * 4 + c]));
+        }
+    }
+
+    // inset the bounding box to reduce mean error
+    for (int c = 0; c < 3; ++c)
+    {
+        const int inset = (max_c[c] - min_c[c]) >> 4;
+        min_c[c] = std::min(min_c[c] + inset, 255);
+        max_c[c] = std::max(max_c[c] - inset, 0);
+    }
+
+    uint16_t c0 = pack_565(max_c[0], max_c[1], max_c[2]);
+    uint16_t c1 = pack_565(min_c[0], min_c[1], min_c[2]);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, best_dist = INT32_MAX;
+            for (int p = 0; p < 4; ++p)
+            {
+                int dist = 0;
+                for (int c = 0; c < 3; ++c) {
+                    const int d = block[i * 4 + c] - palette[p][c];
+                    dist += d * d;
+                }
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+
+    dst[0] = c0 & 0xff;
+    dst[1] = c0 >> 8;
+    dst[2] = c1 & 0xff;
+    dst[3] = c1 >> 8;
+    memcpy(dst + 4, &indices, 4);
+}
+
+void decode_color_block(const uint8_t* src, uint8_t* block, bool force_4_colors)
+{
+    const uint16_t c0 = src[0] | (src[1] << 8);
+    const uint16_t c1 = src[2] | (src[3] << 8);
+
+    int palette[4][4];
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    if (c0 > c1 || force_4_colors)
+    {
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+    else
+    {
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+        palette[3][3] = 0;
+    }
+
+    uint32_t indices;
+    memcpy(&indices, src + 4, 4);
+    for (int i = 0; i < 16; ++i)
+    {
+        const int idx = (indices >> (i * 2)) & 0x3;
+        for (int c = 0; c < 4; ++c) {
+            block[i * 4 + c] = static_cast<uint8_t>(palette[idx][c]);
+        }
+    }
+}
+
+// block: 16 values with stride
+void encode_alpha_block(const uint8_t* block, int stride, uint8_t* dst)
+{
+    int a_min = 255, a_max = 0;
+    for (int i = 0; i < 16; ++i) {
+        a_min = std::min(a_min, static_cast<int>(block[i * stride]));
+        a_max = std::max(a_max, static_cast<int>(block[i * stride]));
+    }
+
+    dst[0] = static_cast<uint8_t>(a_max);
+    dst[1] = static_cast<uint8_t>(a_min);
+
+    uint64_t indices = 0;
+    if (a_max != a_min)
+    {
+        // 8 values mode, a0 > a1
+        int palette[8];
+        palette[0] = a_max;
+        palette[1] = a_min;
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i) * a_max + i * a_min) / 7;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            const int a = block[i * stride];
+            int best = 0, best_dist = INT32_MAX;
+            for (int p = 0; p < 8; ++p)
+            {
+                const int dist = std::abs(a - palette[p]);
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (i * 3);
+        }
+    }
+
+    for (int i = 0; i < 6; ++i) {
+        dst[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+    }
+}
+
+void decode_alpha_block(const uint8_t* src, uint8_t* block, int stride)
+{
+    const int a0 = src[0];
+    const int a1 = src[1];
+
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        }
+    }
+    else
+    {
+        for (int i = 1; i < 5; ++i) {
+            palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) {
+        indices |= static_cast<uint64_t>(src[2 + i]) << (i * 8);
+    }
+    for (int i = 0; i < 16; ++i) {
+        block[i * stride] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 0x7]);
+    }
+}
+
+void encode_rows(clipmap::BlockCompress::Format fmt, const uint8_t* src, int width,
+                 int by_begin, int by_end, uint8_t* dst)
+{
+    using Format = clipmap::BlockCompress::Format;
+
+    const int channels = clipmap::BlockCompress::SrcChannels(fmt);
+    const size_t block_bytes = clipmap::BlockCompress::BlockBytes(fmt);
+    const int bw = width / 4;
+
+    uint8_t block[16 * 4];
+    for (int by = by_begin; by < by_end; ++by)
+    {
+        for (int bx = 0; bx < bw; ++bx)
+        {
+            for (int y = 0; y < 4; ++y) {
+                const uint8_t* row = src + ((by * 4 + y) * width + bx * 4) * channels;
+                memcpy(&block[y * 4 * channels], row, 4 * channels);
+            }
+
+            uint8_t* out = dst + (static_cast<size_t>(by) * bw + bx) * block_bytes;
+            switch (fmt)
+            {
+            case Format::BC1:
+                encode_color_block(block, out);
+                break;
+            case Format::BC3:
+                encode_alpha_block(block + 3, 4, out);
+                encode_color_block(block, out + 8);
+                break;
+            case Format::BC4:
+                encode_alpha_block(block, 1, out);
+                break;
+            case Format::BC5:
+                encode_alpha_block(block, 2, out);
+                encode_alpha_block(block + 1, 2, out + 8);
+                break;
+            }
+        }
+    }
+}
+
+}
+
+namespace clipmap
+{
+
+int BlockCompress::SrcChannels(Format fmt)
+{
+    switch (fmt)
+    {
+    case Format::BC1:
+    case Format::BC3:
+        return 4;
+    case Format::BC4:
+        return 1;
+    case Format::BC5:
+        return 2;
+    }
+    assert(0);
+    return 0;
+}
+
+size_t BlockCompress::BlockBytes(Format fmt)
+{
+    return fmt == Format::BC1 || fmt == Format::BC4 ? 8 : 16;
+}
+
+size_t BlockCompress::CalcSize(Format fmt, int width, int height)
+{
+    return static_cast<size_t>(width / 4) * (height / 4) * BlockBytes(fmt);
+}
+
+void BlockCompress::Encode(Format fmt, const uint8_t* src, int width, int height,
+                           uint8_t* dst, int thread_num)
+{
+    assert(width % 4 == 0 && height % 4 == 0);
+
+    const int bh = height / 4;
+    thread_num = std::max(1, std::min(thread_num, bh));
+    if (thread_num == 1) {
+        encode_rows(fmt, src, width, 0, bh, dst);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_num);
+    const int step = (bh + thread_num - 1) / thread_num;
+    for (int begin = 0; begin < bh; begin += step) {
+        threads.emplace_back(encode_rows, fmt, src, width, begin, std::min(begin + step, bh), dst);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void BlockCompress::Decode(Format fmt, const uint8_t* src, int width, int height,
+                           uint8_t* dst)
+{
+    assert(width % 4 == 0 && height % 4 == 0);
+
+    const int channels = SrcChannels(fmt);
+    const size_t block_bytes = BlockBytes(fmt);
+    const int bw = width / 4;
+    const int bh = height / 4;
+
+    uint8_t block[16 * 4];
+    for (int by = 0; by < bh; ++by)
+    {
+        for (int bx = 0; bx < bw; ++bx)
+        {
+            const uint8_t* in = src + (static_cast<size_t>(by) * bw + bx) * block_bytes;
+            switch (fmt)
+            {
+            case Format::BC1:
+                decode_color_block(in, block, false);
+                break;
+            case Format::BC3:
+                decode_color_block(in + 8, block, true);
+                decode_alpha_block(in, block + 3, 4);
+                break;
+            case Format::BC4:
+                decode_alpha_block(in, block, 1);
+                break;
+            case Format::BC5:
+                decode_alpha_block(in, block, 2);
+                decode_alpha_block(in + 8, block + 1, 2);
+                break;
+            }
+
+            for (int y = 0; y < 4; ++y) {
+                uint8_t* row = dst + ((by * 4 + y) * width + bx * 4) * channels;
+                memcpy(row, &block[y * 4 * channels], 4 * channels);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,109 @@
+#include "clipmap/CameraTrace.h"
+
+#include <fstream>
+#include <random>
+#include <cmath>
+
+namespace clipmap
+{
+
+CameraTrace CameraTrace::LinearPan(size_t frame_num, float scale,
+                                   const sm::vec2& start, const sm::vec2& step)
+{
+    CameraTrace trace;
+    trace.m_frames.reserve(frame_num);
+    for (size_t i = 0; i < frame_num; ++i) {
+        trace.Record(scale, start + step * static_cast<float>(i));
+    }
+    return trace;
+}
+
+CameraTrace CameraTrace::ZoomDive(size_t frame_num, const sm::vec2& center,
+                                  float scale_begin, float scale_end, float view_size)
+{
+    CameraTrace trace;
+    trace.m_frames.reserve(frame_num);
+    const float ratio = scale_end / scale_begin;
+    for (size_t i = 0; i < frame_num; ++i)
+    {
+        const float t = frame_num > 1 ? static_cast<float>(i) / (frame_num - 1) : 0.0f;
+        const float scale = scale_begin * std::pow(ratio, t);
+        const float half = view_size * scale * 0.5f;
+        trace.Record(scale, center - sm::vec2(half, half));
+    }
+    return trace;
+}
+
+CameraTrace CameraTrace::RandomJumps(size_t frame_num, const sm::vec2& extent,
+                                     float scale_min, float scale_max, uint32_t seed)
+{
+    CameraTrace trace;
+    trace.m_frames.reserve(frame_num);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist_x(0, extent.x);
+    std::uniform_real_distribution<float> dist_y(0, extent.y);
+    std::uniform_real_distribution<float> dist_s(std::log2(scale_min), std::log2(scale_max));
+    for (size_t i = 0; i < frame_num; ++i)
+    {
+        const float scale = std::pow(2.0f, dist_s(rng));
+        const float x = dist_x(rng);
+        const float y = dist_y(rng);
+        trace.Record(scale, sm::vec2(x, y));
+    }
+    return trace;
+}
+
+CameraTrace CameraTrace::Orbit(size_t frame_num, const sm::vec2& center,
+                               float radius, float scale, float view_size)
+{
+    CameraTrace trace;
+    trace.m_frames.reserve(frame_num);
+    const float half = view_size * scale * 0.5f;
+    for (size_t i = 0; i < frame_num; ++i)
+    {
+        const float a = 2 * 3.1415926f * i / frame_num;
+        const sm::vec2 c(center.x + std::cos(a) * radius, center.y + std::sin(a) * radius);
+        trace.Record(scale, c - sm::vec2(half, half));
+    }
+    return trace;
+}
+
+bool CameraTrace::Load(const std::string& filepath)
+{
+    std::ifstream fin(filepath);
+    if (!fin.is_open()) {
+        return false;
+    }
+
+    m_frames.clear();
+
+    Frame frame;
+    while (fin >> frame.scale >> frame.offset.x >> frame.offset.y) {
+        m_frames.push_back(frame);
+    }
+    return true;
+}
+
+bool CameraTrace::Save(const std::string& filepath) const
+{
+    std::ofstream fout(filepath);
+    if (!fout.is_open()) {
+        return false;
+    }
+
+    for (auto& frame : m_frames) {
+        fout << frame.scale << " " << frame.offset.x << " " << frame.offset.y << "\n";
+    }
+    return true;
+}
+
+void CameraTrace::Record(float scale, const sm::vec2& offset)
+{
+    Frame frame;
+    frame.scale  = scale;
+    frame.offset = offset;
+    m_frames.push_back(frame);
+}
+
+}
@@ -1,26 +1,134 @@
 #include "clipmap/Clipmap.h"
 
+#include <cmath>
+
 namespace clipmap
 {
 
-Clipmap::Clipmap(const std::string& filepath, const textile::VTexInfo& info)
-    : m_info(info)
-    , m_indexer(m_info)
-    , m_loader(filepath, m_indexer)
-    , m_cache(m_loader, m_indexer, m_stack)
-    , m_stack(m_info)
+Clipmap::Clipmap(const std::string& filepath, const textile::VTexInfo& info,
+                 size_t io_thread_num, size_t cache_budget, const Config& cfg)
+    : Clipmap(std::make_shared<PageService>(filepath, info, io_thread_num, cache_budget), cfg)
+{
+}
+
+Clipmap::Clipmap(const std::shared_ptr<PageService>& service, const Config& cfg)
+    : m_service(service)
+    , m_stack(m_service->GetVTexInfo(), cfg)
+    , m_viewport(0, 0, static_cast<float>(cfg.viewport_width), static_cast<float>(cfg.viewport_height))
+{
+    m_service->AddView(m_stack);
+
+#if CLIPMAP_STATS
+    m_stack.SetStats(&m_stats);
+#endif
+}
+
+Clipmap::~Clipmap()
 {
+    m_service->RemoveView(m_stack);
 }
 
 void Clipmap::Init(const ur::Device& dev)
 {
+    m_service->Init(dev);
     m_stack.Init(dev);
 }
 
+void Clipmap::SetConfig(const ur::Device& dev, const Config& cfg)
+{
+    m_viewport = sm::rect(0, 0, static_cast<float>(cfg.viewport_width), static_cast<float>(cfg.viewport_height));
+    m_stack.SetConfig(dev, cfg);
+}
+
 void Clipmap::Update(const ur::Device& dev, ur::Context& ctx,
                      float scale, const sm::vec2& offset)
 {
-    m_stack.Update(dev, ctx, m_cache, m_viewport, scale, offset);
+    BeginFrame();
+
+    auto& cache = m_service->GetCache();
+    m_stack.Update(dev, ctx, cache, m_viewport, scale, offset, &m_budget);
+
+    if (m_prefetch_frames > 0 && cache.IsStreaming()) {
+        PrefetchPages(scale, offset);
+    }
+
+    EndFrame(dev, ctx);
+}
+
+void Clipmap::Update(const ur::Device& dev, ur::Context& ctx,
+                     const sm::mat4& view_proj, const FrustumFootprint::Params& params)
+{
+    BeginFrame();
+
+    const size_t level = FrustumFootprint::CalcRegions(m_service->GetVTexInfo(),
+        m_stack.GetAllLayers().size(), m_stack.GetConfig().ring_size, view_proj,
+        params, m_regions, m_stack.GetMinLevel());
+    m_stack.Update(dev, ctx, m_service->GetCache(), m_regions, level, &m_budget);
+
+    EndFrame(dev, ctx);
+}
+
+void Clipmap::BeginFrame()
+{
+    m_stats.BeginFrame();
+    m_budget.BeginFrame();
+
+    // cache counters of this call go to this view
+#if CLIPMAP_STATS
+    m_service->GetCache().SetStats(&m_stats);
+#endif
+}
+
+void Clipmap::EndFrame(const ur::Device& dev, ur::Context& ctx)
+{
+    auto& cache = m_service->GetCache();
+
+    // upload pages finished by the streaming workers, other views pick
+    // up theirs in their own Update()
+    {
+        CLIPMAP_STAT_TIMER(m_stats.GetCurrFrame(), load_ms);
+        m_service->Flush(dev, &m_budget);
+    }
+    m_stack.FlushPages(dev, ctx, cache);
+
+#if CLIPMAP_STATS
+    cache.SetStats(nullptr);
+#endif
+}
+
+void Clipmap::EnablePrefetch(int frame_num, size_t budget)
+{
+    m_prefetch_frames = frame_num;
+    m_service->GetCache().SetPrefetchBudget(budget);
+}
+
+void Clipmap::PrefetchPages(float scale, const sm::vec2& offset)
+{
+    // smoothed per-frame motion, zoom as a ratio
+    const float k = 0.5f;
+    if (m_last_scale > 0)
+    {
+        m_scale_vel = m_scale_vel * (1 - k) + scale / m_last_scale * k;
+        m_offset_vel = m_offset_vel * (1 - k) + (offset - m_last_offset) * k;
+    }
+    m_last_scale = scale;
+    m_last_offset = offset;
+
+    // predictions of last frame are stale
+    m_service->GetCache().CancelPrefetch();
+
+    const float EPSILON = 0.0001f;
+    if (std::abs(m_scale_vel - 1) < EPSILON && m_offset_vel.Length() < EPSILON) {
+        return;
+    }
+
+    // nearest frames first, they get the budget
+    for (int i = 1; i <= m_prefetch_frames; ++i)
+    {
+        const float pred_scale = scale * std::pow(m_scale_vel, static_cast<float>(i));
+        const sm::vec2 pred_offset = offset + m_offset_vel * static_cast<float>(i);
+        m_stack.Prefetch(m_service->GetCache(), m_viewport, pred_scale, pred_offset);
+    }
 }
 
 void Clipmap::GetRegion(float& scale, sm::vec2& offset) const
@@ -0,0 +1,153 @@
+#include "clipmap/ClipmapSet.h"
+
+#include <algorithm>
+
+#include <assert.h>
+
+namespace clipmap
+{
+
+ClipmapSet::ClipmapSet(const std::vector<std::string>& filepaths, const std::vector<textile::VTexInfo>& infos,
+                       size_t io_thread_num, size_t cache_budget, const Config& cfg)
+    : m_viewport(0, 0, static_cast<float>(cfg.viewport_width), static_cast<float>(cfg.viewport_height))
+{
+    assert(!filepaths.empty() && filepaths.size() == infos.size());
+
+    m_channels.resize(filepaths.size());
+    for (size_t i = 0, n = filepaths.size(); i < n; ++i)
+    {
+        // the diff of channel 0 is applied to all
+        assert(infos[i].vtex_width == infos[0].vtex_width
+            && infos[i].vtex_height == infos[0].vtex_height
+            && infos[i].tile_size == infos[0].tile_size);
+
+        auto& c = m_channels[i];
+        c.service = std::make_shared<PageService>(filepaths[i], infos[i], io_thread_num, cache_budget);
+        c.stack = std::make_unique<TextureStack>(c.service->GetVTexInfo(), cfg);
+        c.service->AddView(*c.stack);
+
+#if CLIPMAP_STATS
+        c.stack->SetStats(&m_stats);
+#endif
+    }
+}
+
+ClipmapSet::~ClipmapSet()
+{
+    for (auto& c : m_channels) {
+        c.service->RemoveView(*c.stack);
+    }
+}
+
+void ClipmapSet::Init(const ur::Device& dev)
+{
+    for (auto& c : m_channels) {
+        c.service->Init(dev);
+        c.stack->Init(dev);
+    }
+}
+
+void ClipmapSet::Update(const ur::Device& dev, ur::Context& ctx,
+                        float scale, const sm::vec2& offset)
+{
+    m_stats.BeginFrame();
+    m_budget.BeginFrame();
+
+#if CLIPMAP_STATS
+    for (auto& c : m_channels) {
+        c.service->GetCache().SetStats(&m_stats);
+    }
+#endif
+
+    for (auto& c : m_channels) {
+        if (!c.stack->GetMipTail().IsLoaded()) {
+            c.stack->LoadMipTail(dev, c.service->GetCache());
+        }
+    }
+
+    // one traversal for all channels
+    auto& front = *m_channels.front().stack;
+    if (front.IsViewChanged(m_viewport, scale, offset))
+    {
+        front.CalcViewDiff(m_viewport, scale, offset, m_view_diff);
+        for (auto& c : m_channels) {
+            c.stack->ApplyViewDiff(c.service->GetCache(), m_view_diff);
+        }
+    }
+
+    WritePendingPages(dev);
+
+    FlushLoadedPages(dev);
+    for (auto& c : m_channels) {
+        c.stack->FlushPages(dev, ctx, c.service->GetCache());
+    }
+
+#if CLIPMAP_STATS
+    for (auto& c : m_channels) {
+        c.service->GetCache().SetStats(nullptr);
+    }
+#endif
+}
+
+void ClipmapSet::GetRegion(float& scale, sm::vec2& offset) const
+{
+    m_channels.front().stack->GetRegion(scale, offset);
+}
+
+void ClipmapSet::Draw(const ur::Device& dev, ur::Context& ctx, size_t channel,
+                      float screen_width, float screen_height) const
+{
+    assert(channel < m_channels.size());
+    m_channels[channel].stack->Draw(dev, ctx, screen_width, screen_height);
+}
+
+size_t ClipmapSet::GetPendingPages() const
+{
+    size_t ret = 0;
+    for (auto& c : m_channels) {
+        ret = std::max(ret, c.stack->GetPendingCount());
+    }
+    return ret;
+}
+
+void ClipmapSet::WritePendingPages(const ur::Device& dev)
+{
+    CLIPMAP_STAT_TIMER(m_stats.GetCurrFrame(), load_ms);
+
+    // the queues are built from the same diff, so each round requests
+    // one page coordinate from every channel's file back to back
+    bool more = true;
+    while (more && !m_budget.IsExhausted())
+    {
+        more = false;
+        for (auto& c : m_channels) {
+            more |= c.stack->WriteNextPendingPage(dev, c.service->GetCache(), &m_budget);
+        }
+    }
+}
+
+void ClipmapSet::FlushLoadedPages(const ur::Device& dev)
+{
+    CLIPMAP_STAT_TIMER(m_stats.GetCurrFrame(), load_ms);
+
+    if (m_budget.IsUnlimited())
+    {
+        for (auto& c : m_channels) {
+            c.service->Flush(dev, &m_budget);
+        }
+        return;
+    }
+
+    // one loaded page from every channel per round, so the first channel
+    // does not use up the budget and leave the others behind
+    bool more = true;
+    while (more && !m_budget.IsExhausted())
+    {
+        more = false;
+        for (auto& c : m_channels) {
+            more |= c.service->Flush(dev, &m_budget, 1) > 0;
+        }
+    }
+}
+
+}
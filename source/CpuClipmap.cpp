@@ -0,0 +1,43 @@
+#include "clipmap/CpuClipmap.h"
+
+#include <thread>
+#include <algorithm>
+
+namespace
+{
+
+size_t thread_num_or_cores(size_t thread_num)
+{
+    return thread_num > 0 ? thread_num : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+}
+
+namespace clipmap
+{
+
+CpuClipmap::CpuClipmap(const std::string& filepath, const textile::VTexInfo& info,
+                       size_t thread_num)
+    : m_info(info)
+    , m_indexer(m_info)
+    , m_streamer(filepath, m_info, m_indexer, thread_num_or_cores(thread_num))
+    , m_stack(m_info, 512, thread_num)
+{
+}
+
+void CpuClipmap::Update(float scale, const sm::vec2& offset)
+{
+    m_stack.Update(m_streamer, m_viewport, scale, offset);
+}
+
+void CpuClipmap::GetRegion(float& scale, sm::vec2& offset) const
+{
+    m_stack.GetRegion(scale, offset);
+}
+
+void CpuClipmap::Draw(uint8_t* dst, int width, int height) const
+{
+    m_stack.Draw(dst, width, height);
+}
+
+}
@@ -0,0 +1,297 @@
+#include "clipmap/CpuTextureStack.h"
+#include "clipmap/TextureStack.h"
+#include "clipmap/PageStreamer.h"
+#include "clipmap/PixelConvert.h"
+
+#include <textile/VTexInfo.h>
+
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+
+template <typename Func>
+void parallel_for(size_t count, size_t thread_num, Func func)
+{
+    thread_num = std::min(thread_num, count);
+    if (thread_num <= 1)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_num);
+    for (size_t t = 0; t < thread_num; ++t)
+    {
+        threads.emplace_back([=, &func]() {
+            for (size_t i = t; i < count; i += thread_num) {
+                func(i);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+}
+
+namespace clipmap
+{
+
+CpuTextureStack::CpuTextureStack(const textile::VTexInfo& info, size_t ring_size,
+                                 size_t thread_num)
+    : m_vtex_info(info)
+    , m_ring_size(ring_size)
+    , m_thread_num(thread_num)
+{
+    if (m_thread_num == 0) {
+        m_thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    auto mip_count = static_cast<int>(std::log2(std::min(info.PageTableWidth(), info.PageTableHeight()))) + 1;
+    m_layers.resize(mip_count);
+    for (auto& layer : m_layers) {
+        layer.pixels.resize(m_ring_size * m_ring_size * info.channels, 0);
+    }
+}
+
+void CpuTextureStack::Update(PageStreamer& streamer, const sm::rect& viewport,
+                             float scale, const sm::vec2& offset)
+{
+    // compared once clamped, a view pushed past the edge is no change
+    float    new_scale  = scale;
+    sm::vec2 new_offset = offset;
+    std::vector<sm::rect> regions;
+    const size_t mipmap_level = TextureStack::CalcRegions(
+        m_vtex_info, m_layers.size(), viewport, new_scale, new_offset, regions
+    );
+    if (m_scale == new_scale && m_offset == new_offset && m_viewport == viewport) {
+        return;
+    }
+
+    m_viewport = viewport;
+    m_scale    = new_scale;
+    m_offset   = new_offset;
+
+    m_stats = UpdateStats();
+
+    std::vector<sm::rect> old_regions;
+    old_regions.reserve(m_layers.size());
+    for (auto& layer : m_layers) {
+        old_regions.push_back(layer.region);
+    }
+
+    RectDiff::PageSet blits;
+    RectDiff::CalcDiffPages(m_vtex_info, old_regions, regions, mipmap_level, blits);
+    for (auto& blit : blits) {
+        if (streamer.Submit(blit.page)) {
+            ++m_stats.pages_requested;
+        }
+    }
+
+    const size_t page_bytes = m_vtex_info.tile_size * m_vtex_info.tile_size
+        * m_vtex_info.channels * m_vtex_info.bytes;
+    std::unordered_map<uint64_t, std::vector<uint8_t>> page_data;
+    auto on_loaded = [&](const textile::Page& page, const uint8_t* data, bool) {
+        page_data[RectDiff::PageKey(page)].assign(data, data + page_bytes);
+        ++m_stats.pages_loaded;
+        m_stats.bytes_loaded += page_bytes;
+    };
+    std::vector<textile::Page> failed;
+    auto on_fail = [&](const textile::Page& page) {
+        failed.push_back(page);
+    };
+    streamer.Drain(on_loaded, on_fail);
+
+    // one more try
+    if (!failed.empty())
+    {
+        std::vector<textile::Page> retry;
+        retry.swap(failed);
+        for (auto& page : retry) {
+            streamer.Submit(page);
+        }
+        streamer.Drain(on_loaded, on_fail);
+    }
+    m_stats.pages_failed = failed.size();
+    m_stats.blits = blits.size();
+
+    // old - new, pages still partly in the new region stay
+    RectDiff::PageSet dropped;
+    for (size_t i = mipmap_level, n = m_layers.size(); i < n; ++i) {
+        RectDiff::CalcDiffPages(m_vtex_info, regions[i - mipmap_level], old_regions[i], i, dropped);
+    }
+    std::unordered_set<uint64_t> evicted;
+    for (auto& p : dropped)
+    {
+        auto& r = regions[p.page.mip - mipmap_level];
+        const float tile_sz = static_cast<float>(m_vtex_info.tile_size * std::pow(2, p.page.mip));
+        const bool overlap = p.page.x * tile_sz < r.xmax && p.page.x * tile_sz + tile_sz > r.xmin
+                          && p.page.y * tile_sz < r.ymax && p.page.y * tile_sz + tile_sz > r.ymin;
+        if (!overlap) {
+            evicted.insert(RectDiff::PageKey(p.page));
+        }
+    }
+    m_stats.pages_evicted = evicted.size();
+
+    for (size_t i = mipmap_level, n = m_layers.size(); i < n; ++i) {
+        m_layers[i].region = regions[i - mipmap_level];
+    }
+
+    // pages land in disjoint parts of the rings
+    parallel_for(blits.size(), m_thread_num, [&](size_t i)
+    {
+        auto itr = page_data.find(RectDiff::PageKey(blits[i].page));
+        if (itr != page_data.end()) {
+            BlitPage(blits[i], itr->second.data());
+        }
+    });
+}
+
+void CpuTextureStack::Draw(uint8_t* dst, int width, int height) const
+{
+    if (m_scale == 0 || !m_viewport.IsValid()) {
+        memset(dst, 0, static_cast<size_t>(width) * height * m_vtex_info.channels);
+        return;
+    }
+
+    const size_t level = TextureStack::CalcMipmapLevel(m_layers.size(), m_scale);
+    auto& layer = m_layers[level];
+
+    // same as final_vs, in ring uv
+    const float level_scale = static_cast<float>(std::pow(2, level));
+    const sm::vec2 uv_scale(
+        m_viewport.Width() * m_scale / level_scale / m_ring_size,
+        m_viewport.Height() * m_scale / level_scale / m_ring_size
+    );
+    const sm::vec2 uv_offset = m_offset / static_cast<float>(m_ring_size) / level_scale;
+
+    const size_t channels = m_vtex_info.channels;
+    parallel_for(height, m_thread_num, [&](size_t y)
+    {
+        const float v = (y + 0.5f) / height * uv_scale.y + uv_offset.y;
+        uint8_t* row = dst + y * width * channels;
+        for (int x = 0; x < width; ++x)
+        {
+            const float u = (x + 0.5f) / width * uv_scale.x + uv_offset.x;
+            SampleLayer(layer, u, v, row + x * channels);
+        }
+    });
+}
+
+float CpuTextureStack::Sample(size_t level, float x, float y, size_t channel) const
+{
+    assert(level < m_layers.size() && channel < m_vtex_info.channels);
+    auto& layer = m_layers[level];
+    if (layer.pixels.empty()) {
+        return 0;
+    }
+
+    // texel centers, wrapping around the ring
+    const int sz = static_cast<int>(m_ring_size);
+    const float level_scale = static_cast<float>(std::pow(2, level));
+    const float fx = x / level_scale - 0.5f;
+    const float fy = y / level_scale - 0.5f;
+    const int ix = static_cast<int>(std::floor(fx));
+    const int iy = static_cast<int>(std::floor(fy));
+    const float tx = fx - ix;
+    const float ty = fy - iy;
+
+    const int x0 = (ix % sz + sz) % sz, x1 = (x0 + 1) % sz;
+    const int y0 = (iy % sz + sz) % sz, y1 = (y0 + 1) % sz;
+
+    const size_t channels = m_vtex_info.channels;
+    auto texel = [&](int x, int y) -> float {
+        return layer.pixels[(static_cast<size_t>(y) * sz + x) * channels + channel];
+    };
+    const float top = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * tx;
+    const float bot = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * tx;
+    return (top + (bot - top) * ty) / 255.0f;
+}
+
+size_t CpuTextureStack::GetChannels() const
+{
+    return m_vtex_info.channels;
+}
+
+void CpuTextureStack::BlitPage(const RectDiff::PageRegion& blit, const uint8_t* data)
+{
+    auto& page = blit.page;
+    auto& region = blit.region;
+    auto& layer = m_layers[page.mip];
+
+    const int tile_sz  = static_cast<int>(m_vtex_info.tile_size);
+    const int channels = static_cast<int>(m_vtex_info.channels);
+    const int bytes    = static_cast<int>(m_vtex_info.bytes);
+    const float level_scale = static_cast<float>(std::pow(2, page.mip));
+
+    // updated part of the page, in page texels
+    const float page_x = page.x * tile_sz * level_scale;
+    const float page_y = page.y * tile_sz * level_scale;
+    const int x0 = std::max(0, static_cast<int>(std::floor((region.xmin - page_x) / level_scale)));
+    const int y0 = std::max(0, static_cast<int>(std::floor((region.ymin - page_y) / level_scale)));
+    const int x1 = std::min(tile_sz, static_cast<int>(std::ceil((region.xmax - page_x) / level_scale)));
+    const int y1 = std::min(tile_sz, static_cast<int>(std::ceil((region.ymax - page_y) / level_scale)));
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    const int tile_n = static_cast<int>(m_ring_size) / tile_sz;
+    const int dst_x = TextureStack::WrapPageSlot(page.x, tile_n) * tile_sz;
+    const int dst_y = TextureStack::WrapPageSlot(page.y, tile_n) * tile_sz;
+
+    const size_t row_len = static_cast<size_t>(x1 - x0) * channels;
+    for (int y = y0; y < y1; ++y)
+    {
+        const uint8_t* src = data + (static_cast<size_t>(y) * tile_sz + x0) * channels * bytes;
+        uint8_t* dst = &layer.pixels[((dst_y + y) * m_ring_size + dst_x + x0) * channels];
+        if (bytes == 2) {
+            PixelConvert::U16ToU8(reinterpret_cast<const uint16_t*>(src), dst, row_len);
+        } else {
+            memcpy(dst, src, row_len);
+        }
+    }
+}
+
+void CpuTextureStack::SampleLayer(const Layer& layer, float u, float v, uint8_t* dst) const
+{
+    // bilinear, wrapping around the ring
+    const int sz = static_cast<int>(m_ring_size);
+    const float fx = (u - std::floor(u)) * sz - 0.5f;
+    const float fy = (v - std::floor(v)) * sz - 0.5f;
+    const int ix = static_cast<int>(std::floor(fx));
+    const int iy = static_cast<int>(std::floor(fy));
+    const float tx = fx - ix;
+    const float ty = fy - iy;
+
+    const int x0 = (ix % sz + sz) % sz, x1 = (x0 + 1) % sz;
+    const int y0 = (iy % sz + sz) % sz, y1 = (y0 + 1) % sz;
+
+    const size_t channels = m_vtex_info.channels;
+    auto texel = [&](int x, int y) {
+        return &layer.pixels[(static_cast<size_t>(y) * sz + x) * channels];
+    };
+    const uint8_t* p00 = texel(x0, y0);
+    const uint8_t* p10 = texel(x1, y0);
+    const uint8_t* p01 = texel(x0, y1);
+    const uint8_t* p11 = texel(x1, y1);
+    for (size_t c = 0; c < channels; ++c)
+    {
+        const float top = p00[c] + (p10[c] - p00[c]) * tx;
+        const float bot = p01[c] + (p11[c] - p01[c]) * tx;
+        dst[c] = static_cast<uint8_t>(top + (bot - top) * ty + 0.5f);
+    }
+}
+
+}
@@ -0,0 +1,58 @@
+#include "clipmap/EvictPolicy.h"
+#include "clipmap/TextureStack.h"
+
+#include <assert.h>
+
+namespace clipmap
+{
+
+EvictPolicy::PageList::const_iterator
+LRUEvictPolicy::SelectVictim(const PageList& lru) const
+{
+    assert(!lru.empty());
+    return std::prev(lru.end());
+}
+
+ClipmapEvictPolicy::ClipmapEvictPolicy(const TextureStack& stack, int protect_levels)
+    : m_protect_levels(protect_levels)
+{
+    m_stacks.push_back(&stack);
+}
+
+EvictPolicy::PageList::const_iterator
+ClipmapEvictPolicy::SelectVictim(const PageList& lru) const
+{
+    assert(!lru.empty());
+    for (auto itr = lru.rbegin(); itr != lru.rend(); ++itr) {
+        if (!IsProtected(*itr)) {
+            return std::prev(itr.base());
+        }
+    }
+
+    // everything is in use, fall back to lru
+    return std::prev(lru.end());
+}
+
+bool ClipmapEvictPolicy::IsProtected(const textile::Page& page) const
+{
+    for (auto& stack : m_stacks) {
+        if (IsProtected(*stack, page)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ClipmapEvictPolicy::IsProtected(const TextureStack& stack, const textile::Page& page) const
+{
+    // copied to the tail texture once, not needed after that
+    auto& tail = stack.GetMipTail();
+    if (page.mip >= static_cast<int>(tail.first_level)) {
+        return !tail.IsLoaded();
+    }
+
+    const int coarse_begin = static_cast<int>(stack.GetAllLayers().size()) - m_protect_levels;
+    return page.mip >= coarse_begin || stack.IsPageInRegion(page);
+}
+
+}
@@ -0,0 +1,240 @@
+#include "clipmap/FrustumFootprint.h"
+
+#include <textile/VTexInfo.h>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include <assert.h>
+
+namespace
+{
+
+// column major, false if singular
+bool invert(const float* m, float* out)
+{
+    float inv[16];
+    inv[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8]  =  m[4] * m[9]  * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9]  * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9]  = -m[0] * m[9]  * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] =  m[0] * m[9]  * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2]  =  m[1] * m[6]  * m[15] - m[1] * m[7]  * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7]  - m[13] * m[3] * m[6];
+    inv[6]  = -m[0] * m[6]  * m[15] + m[0] * m[7]  * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7]  + m[12] * m[3] * m[6];
+    inv[10] =  m[0] * m[5]  * m[15] - m[0] * m[7]  * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7]  - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5]  * m[14] + m[0] * m[6]  * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6]  + m[12] * m[2] * m[5];
+    inv[3]  = -m[1] * m[6]  * m[11] + m[1] * m[7]  * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9]  * m[2] * m[7]  + m[9]  * m[3] * m[6];
+    inv[7]  =  m[0] * m[6]  * m[11] - m[0] * m[7]  * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8]  * m[2] * m[7]  - m[8]  * m[3] * m[6];
+    inv[11] = -m[0] * m[5]  * m[11] + m[0] * m[7]  * m[9]  + m[4] * m[1] * m[11] - m[4] * m[3] * m[9]  - m[8]  * m[1] * m[7]  + m[8]  * m[3] * m[5];
+    inv[15] =  m[0] * m[5]  * m[10] - m[0] * m[6]  * m[9]  - m[4] * m[1] * m[10] + m[4] * m[2] * m[9]  + m[8]  * m[1] * m[6]  - m[8]  * m[2] * m[5];
+
+    const float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (det == 0) {
+        return false;
+    }
+    for (int i = 0; i < 16; ++i) {
+        out[i] = inv[i] / det;
+    }
+    return true;
+}
+
+// ndc to world, with the perspective divide
+void unproject(const float* inv, float x, float y, float z, float* out)
+{
+    float p[4];
+    for (int i = 0; i < 4; ++i) {
+        p[i] = inv[i] * x + inv[4 + i] * y + inv[8 + i] * z + inv[12 + i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        out[i] = p[i] / p[3];
+    }
+}
+
+struct Sample
+{
+    bool valid = false;
+    // level 0 texels
+    float x = 0, y = 0;
+    float lod = std::numeric_limits<float>::max();
+};
+
+void add_point(sm::rect& r, float x, float y)
+{
+    r.xmin = std::min(r.xmin, x);
+    r.ymin = std::min(r.ymin, y);
+    r.xmax = std::max(r.xmax, x);
+    r.ymax = std::max(r.ymax, y);
+}
+
+void add_rect(sm::rect& r, const sm::rect& other)
+{
+    if (other.IsValid()) {
+        add_point(r, other.xmin, other.ymin);
+        add_point(r, other.xmax, other.ymax);
+    }
+}
+
+// cut to max_sz on each axis, keeping the part around anchor
+void fit_extent(float& min, float& max, float max_sz, float anchor)
+{
+    if (max - min <= max_sz) {
+        return;
+    }
+    float begin = std::min(std::max(anchor - max_sz * 0.5f, min), max - max_sz);
+    min = begin;
+    max = begin + max_sz;
+}
+
+}
+
+namespace clipmap
+{
+
+size_t FrustumFootprint::CalcRegions(const textile::VTexInfo& info, size_t layer_num, size_t ring_size,
+                                     const sm::mat4& view_proj, const Params& params, std::vector<sm::rect>& regions,
+                                     size_t min_level)
+{
+    assert(layer_num > 0 && params.grid > 0);
+
+    regions.assign(layer_num, sm::rect());
+
+    float inv[16];
+    if (!invert(view_proj.x, inv)) {
+        return layer_num - 1;
+    }
+
+    // ground hits of the rays through the grid points
+    const int n = params.grid + 1;
+    std::vector<Sample> samples(n * n);
+    for (int j = 0; j < n; ++j)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            const float x = -1 + 2.0f * i / params.grid;
+            const float y = -1 + 2.0f * j / params.grid;
+            float near_p[3], far_p[3];
+            unproject(inv, x, y, -1, near_p);
+            unproject(inv, x, y, 1, far_p);
+
+            // above the horizon, or the plane is past the far plane
+            const float dz = near_p[2] - far_p[2];
+            if (dz == 0) {
+                continue;
+            }
+            const float t = near_p[2] / dz;
+            if (t < 0 || t > 1) {
+                continue;
+            }
+
+            auto& s = samples[j * n + i];
+            s.valid = true;
+            s.x = (near_p[0] + (far_p[0] - near_p[0]) * t) * params.texels_per_unit;
+            s.y = (near_p[1] + (far_p[1] - near_p[1]) * t) * params.texels_per_unit;
+        }
+    }
+
+    // level from the texels per pixel to the neighbours
+    const float px_x = params.screen_width / params.grid;
+    const float px_y = params.screen_height / params.grid;
+    auto texel_dist = [&](const Sample& a, const Sample& b) {
+        const float dx = a.x - b.x, dy = a.y - b.y;
+        return std::sqrt(dx * dx + dy * dy);
+    };
+    float min_lod = std::numeric_limits<float>::max();
+    for (int j = 0; j < n; ++j)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            auto& s = samples[j * n + i];
+            if (!s.valid) {
+                continue;
+            }
+
+            float rho = 0;
+            auto& sx = samples[j * n + (i + 1 < n ? i + 1 : i - 1)];
+            auto& sy = samples[(j + 1 < n ? j + 1 : j - 1) * n + i];
+            if (sx.valid) {
+                rho = std::max(rho, texel_dist(s, sx) / px_x);
+            }
+            if (sy.valid) {
+                rho = std::max(rho, texel_dist(s, sy) / px_y);
+            }
+            if (rho <= 0) {
+                continue;
+            }
+
+            s.lod = std::max(0.0f, std::log2(rho) + params.lod_bias);
+            min_lod = std::min(min_lod, s.lod);
+        }
+    }
+    if (min_lod == std::numeric_limits<float>::max()) {
+        return layer_num - 1;
+    }
+
+    size_t finest = std::min(std::max(static_cast<size_t>(min_lod), min_level), layer_num - 1);
+
+    // the nearest visible ground is kept when a region has to be cut
+    float eye[3];
+    unproject(inv, 0, 0, -1, eye);
+    const float anchor_x = eye[0] * params.texels_per_unit;
+    const float anchor_y = eye[1] * params.texels_per_unit;
+
+    // cells, with the finest level any corner needs
+    for (size_t level = finest; level < layer_num; ++level)
+    {
+        sm::rect r;
+        if (level > finest) {
+            add_rect(r, regions[level - 1]);
+        }
+        for (int j = 0; j + 1 < n; ++j)
+        {
+            for (int i = 0; i + 1 < n; ++i)
+            {
+                const Sample* corners[4] = {
+                    &samples[j * n + i], &samples[j * n + i + 1],
+                    &samples[(j + 1) * n + i], &samples[(j + 1) * n + i + 1]
+                };
+                float lod = std::numeric_limits<float>::max();
+                for (auto c : corners) {
+                    lod = std::min(lod, c->lod);
+                }
+                if (lod >= level + 1) {
+                    continue;
+                }
+                for (auto c : corners) {
+                    if (c->valid) {
+                        add_point(r, c->x, c->y);
+                    }
+                }
+            }
+        }
+        if (!r.IsValid()) {
+            continue;
+        }
+
+        const float max_sz = static_cast<float>(ring_size) * static_cast<float>(std::pow(2, level));
+        fit_extent(r.xmin, r.xmax, max_sz, std::min(std::max(anchor_x, r.xmin), r.xmax));
+        fit_extent(r.ymin, r.ymax, max_sz, std::min(std::max(anchor_y, r.ymin), r.ymax));
+
+        r.xmin = std::max(r.xmin, 0.0f);
+        r.ymin = std::max(r.ymin, 0.0f);
+        r.xmax = std::min(r.xmax, static_cast<float>(info.vtex_width));
+        r.ymax = std::min(r.ymax, static_cast<float>(info.vtex_height));
+        if (r.xmin < r.xmax && r.ymin < r.ymax) {
+            regions[level] = r;
+        }
+    }
+
+    // the nearest ground can be off the texture
+    while (finest + 1 < layer_num && !regions[finest].IsValid()) {
+        ++finest;
+    }
+
+    return finest;
+}
+
+}
@@ -0,0 +1,311 @@
+#include "clipmap/GeometryClipmap.h"
+#include "clipmap/TextureStack.h"
+#include "clipmap/CpuTextureStack.h"
+#include "clipmap/RectDiff.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <assert.h>
+
+namespace clipmap
+{
+
+GeometryClipmap::GeometryClipmap(size_t grid_size, float texels_per_vertex, size_t ring_num)
+    : m_grid_size(grid_size)
+    , m_texels_per_vertex(texels_per_vertex)
+    , m_ring_num(ring_num)
+{
+    // odd, so both grid ends are even and meet the coarser grid
+    assert(grid_size >= 15 && ((grid_size + 1) & grid_size) == 0);
+}
+
+void GeometryClipmap::Update(const std::vector<sm::rect>& regions, size_t start_level,
+                             const HeightSampler& sampler)
+{
+    assert(start_level < regions.size());
+    size_t end_level = regions.size();
+    if (m_ring_num > 0) {
+        end_level = std::min(end_level, start_level + m_ring_num);
+    }
+
+    // rings keep their level when the view zooms, so their heights stay
+    std::vector<Ring> rings(end_level - start_level);
+    for (auto& old : m_rings) {
+        if (old.level >= start_level && old.level < end_level) {
+            rings[old.level - start_level] = std::move(old);
+        }
+    }
+    m_rings.swap(rings);
+
+    m_sample_count = 0;
+
+    // all levels share the center, finer rings first so the coarser cut
+    // their holes where the finer ones are
+    const auto center = regions[start_level].Center();
+    for (size_t i = 0, n = m_rings.size(); i < n; ++i)
+    {
+        const Ring* finer = i > 0 ? &m_rings[i - 1] : nullptr;
+        UpdateRing(m_rings[i], start_level + i, center, finer, i + 1 < n, sampler);
+    }
+}
+
+void GeometryClipmap::Update(const TextureStack& stack, const HeightSampler& sampler)
+{
+    auto& layers = stack.GetAllLayers();
+
+    float scale;
+    sm::vec2 offset;
+    stack.GetRegion(scale, offset);
+    if (scale == 0 || layers.empty()) {
+        return;
+    }
+
+    std::vector<sm::rect> regions;
+    regions.reserve(layers.size());
+    for (auto& layer : layers) {
+        regions.push_back(layer.region);
+    }
+
+    const size_t level = TextureStack::CalcMipmapLevel(static_cast<int>(stack.GetLevelNum()), scale, stack.GetMinLevel());
+    Update(regions, std::min(level, layers.size() - 1), sampler);
+}
+
+void GeometryClipmap::Update(const CpuTextureStack& stack, const HeightSampler& sampler)
+{
+    auto& layers = stack.GetAllLayers();
+
+    float scale;
+    sm::vec2 offset;
+    stack.GetRegion(scale, offset);
+    if (scale == 0 || layers.empty()) {
+        return;
+    }
+
+    std::vector<sm::rect> regions;
+    regions.reserve(layers.size());
+    for (auto& layer : layers) {
+        regions.push_back(layer.region);
+    }
+
+    Update(regions, TextureStack::CalcMipmapLevel(static_cast<int>(layers.size()), scale), sampler);
+}
+
+void GeometryClipmap::Invalidate()
+{
+    for (auto& ring : m_rings) {
+        ring.heights_valid = false;
+    }
+}
+
+size_t GeometryClipmap::GetTriangleCount() const
+{
+    size_t ret = 0;
+    for (auto& ring : m_rings) {
+        ret += ring.indices.size() / 3;
+    }
+    return ret;
+}
+
+void GeometryClipmap::UpdateRing(Ring& ring, size_t level, const sm::vec2& center, const Ring* finer,
+                                 bool has_coarser, const HeightSampler& sampler)
+{
+    const int n = static_cast<int>(m_grid_size);
+    const int half = (n - 1) / 2;
+    const float d = Spacing(level);
+
+    // snapped to even grid coords
+    const int ox = 2 * static_cast<int>(std::floor((center.x / d - half) / 2));
+    const int oy = 2 * static_cast<int>(std::floor((center.y / d - half) / 2));
+
+    // the finer ring covers half as many cells of this level
+    int hx0 = 0, hy0 = 0, hx1 = 0, hy1 = 0;
+    if (finer)
+    {
+        hx0 = finer->origin_x / 2 - ox;
+        hy0 = finer->origin_y / 2 - oy;
+        hx1 = hx0 + half;
+        hy1 = hy0 + half;
+        assert(hx0 >= 1 && hy0 >= 1 && hx1 <= n - 2 && hy1 <= n - 2);
+    }
+
+    const bool resample = !ring.heights_valid || ring.level != level
+        || ring.has_coarser != has_coarser;
+    const bool moved = ring.origin_x != ox || ring.origin_y != oy;
+    const bool hole_changed = ring.hole_x0 != hx0 || ring.hole_y0 != hy0
+        || ring.hole_x1 != hx1 || ring.hole_y1 != hy1;
+    if (!resample && !moved && !hole_changed) {
+        return;
+    }
+
+    const int old_ox = ring.origin_x;
+    const int old_oy = ring.origin_y;
+
+    ring.level = level;
+    ring.origin_x = ox;
+    ring.origin_y = oy;
+    ring.hole_x0 = hx0;
+    ring.hole_y0 = hy0;
+    ring.hole_x1 = hx1;
+    ring.hole_y1 = hy1;
+    ring.has_coarser = has_coarser;
+
+    if (resample)
+    {
+        ring.heights.assign(m_grid_size * m_grid_size, 0);
+        ring.coarse_heights.assign(m_grid_size * m_grid_size, 0);
+        SampleHeights(ring, ox, oy, ox + n, oy + n, has_coarser, sampler);
+        ring.heights_valid = true;
+    }
+    else if (moved)
+    {
+        // only the strips the move exposes, like the texture layers
+        sm::rect parts[4];
+        const int part_n = RectDiff::Subtract(
+            sm::rect(static_cast<float>(ox), static_cast<float>(oy), static_cast<float>(ox + n), static_cast<float>(oy + n)),
+            sm::rect(static_cast<float>(old_ox), static_cast<float>(old_oy), static_cast<float>(old_ox + n), static_cast<float>(old_oy + n)),
+            parts);
+        for (int i = 0; i < part_n; ++i)
+        {
+            auto& r = parts[i];
+            SampleHeights(ring, static_cast<int>(r.xmin), static_cast<int>(r.ymin),
+                static_cast<int>(r.xmax), static_cast<int>(r.ymax), has_coarser, sampler);
+        }
+    }
+
+    if (resample || moved) {
+        BuildVertices(ring, has_coarser);
+    }
+    BuildIndices(ring, has_coarser);
+
+    ++ring.version;
+}
+
+void GeometryClipmap::SampleHeights(Ring& ring, int x0, int y0, int x1, int y1, bool has_coarser,
+                                    const HeightSampler& sampler)
+{
+    const float d = Spacing(ring.level);
+    for (int gy = y0; gy < y1; ++gy)
+    {
+        for (int gx = x0; gx < x1; ++gx)
+        {
+            const size_t slot = Slot(gx, gy);
+            const float x = gx * d;
+            const float y = gy * d;
+            ring.heights[slot] = sampler(ring.level, x, y);
+            ++m_sample_count;
+
+            // the coarser grid only has the even vertices
+            if (has_coarser && (gx & 1) == 0 && (gy & 1) == 0) {
+                ring.coarse_heights[slot] = sampler(ring.level + 1, x, y);
+                ++m_sample_count;
+            }
+        }
+    }
+}
+
+void GeometryClipmap::BuildVertices(Ring& ring, bool has_coarser) const
+{
+    const int n = static_cast<int>(m_grid_size);
+    const float d = Spacing(ring.level);
+
+    // morph over the outer tenth of the ring
+    const float transition = static_cast<float>(std::max((n - 1) / 10, 1));
+
+    auto coarse = [&](int gx, int gy) {
+        return ring.coarse_heights[Slot(gx, gy)];
+    };
+
+    ring.verts.resize(m_grid_size * m_grid_size);
+    for (int j = 0; j < n; ++j)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            const int gx = ring.origin_x + i;
+            const int gy = ring.origin_y + j;
+
+            auto& v = ring.verts[j * n + i];
+            v.x = gx * d;
+            v.y = gy * d;
+            v.height = ring.heights[Slot(gx, gy)];
+            if (!has_coarser)
+            {
+                v.coarse_height = v.height;
+                v.morph = 0;
+                continue;
+            }
+
+            // odd vertices lie on a coarse edge or in a coarse cell, both
+            // ends are inside the ring as it starts and ends even
+            const bool odd_x = (gx & 1) != 0;
+            const bool odd_y = (gy & 1) != 0;
+            if (!odd_x && !odd_y) {
+                v.coarse_height = coarse(gx, gy);
+            } else if (odd_x && !odd_y) {
+                v.coarse_height = (coarse(gx - 1, gy) + coarse(gx + 1, gy)) * 0.5f;
+            } else if (!odd_x && odd_y) {
+                v.coarse_height = (coarse(gx, gy - 1) + coarse(gx, gy + 1)) * 0.5f;
+            } else {
+                v.coarse_height = (coarse(gx - 1, gy - 1) + coarse(gx + 1, gy - 1)
+                    + coarse(gx - 1, gy + 1) + coarse(gx + 1, gy + 1)) * 0.25f;
+            }
+
+            const int dist = std::min(std::min(i, n - 1 - i), std::min(j, n - 1 - j));
+            v.morph = std::max(0.0f, 1.0f - dist / transition);
+        }
+    }
+}
+
+void GeometryClipmap::BuildIndices(Ring& ring, bool has_coarser) const
+{
+    const int n = static_cast<int>(m_grid_size);
+
+    ring.indices.clear();
+    for (int j = 0; j < n - 1; ++j)
+    {
+        for (int i = 0; i < n - 1; ++i)
+        {
+            if (i >= ring.hole_x0 && i < ring.hole_x1 && j >= ring.hole_y0 && j < ring.hole_y1) {
+                continue;
+            }
+
+            const uint32_t a = j * n + i;
+            const uint32_t b = a + 1;
+            const uint32_t c = a + n;
+            const uint32_t e = c + 1;
+            const uint32_t quad[] = { a, b, e, a, e, c };
+            ring.indices.insert(ring.indices.end(), std::begin(quad), std::end(quad));
+        }
+    }
+
+    if (!has_coarser) {
+        return;
+    }
+
+    // the coarser ring has one edge for every two of these, fill the
+    // t-junction on each odd vertex with a degenerate triangle
+    auto idx = [n](int i, int j) { return static_cast<uint32_t>(j * n + i); };
+    for (int k = 0; k + 2 < n; k += 2)
+    {
+        const uint32_t tris[] = {
+            idx(k, 0),     idx(k + 1, 0),     idx(k + 2, 0),
+            idx(k, n - 1), idx(k + 2, n - 1), idx(k + 1, n - 1),
+            idx(0, k),     idx(0, k + 2),     idx(0, k + 1),
+            idx(n - 1, k), idx(n - 1, k + 1), idx(n - 1, k + 2),
+        };
+        ring.indices.insert(ring.indices.end(), std::begin(tris), std::end(tris));
+    }
+}
+
+float GeometryClipmap::Spacing(size_t level) const
+{
+    return m_texels_per_vertex * static_cast<float>(1 << level);
+}
+
+size_t GeometryClipmap::Slot(int gx, int gy) const
+{
+    const int n = static_cast<int>(m_grid_size);
+    return TextureStack::WrapPageSlot(gy, n) * m_grid_size + TextureStack::WrapPageSlot(gx, n);
+}
+
+}
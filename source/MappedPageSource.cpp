@@ -0,0 +1,181 @@
+#include "clipmap/MappedPageSource.h"
+#include "clipmap/PageFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace
+{
+
+size_t os_page_size()
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+}
+
+namespace clipmap
+{
+
+MappedPageSource::MappedPageSource(const std::string& filepath, const textile::VTexInfo& info)
+{
+    m_page_bytes = info.tile_size * info.tile_size * info.channels * info.bytes;
+
+    Map(filepath);
+    // a file that is not a page file is not opened
+    if (m_data && !BuildIndex(info)) {
+        Unmap();
+    }
+}
+
+MappedPageSource::~MappedPageSource()
+{
+    Unmap();
+}
+
+const uint8_t* MappedPageSource::GetPage(int idx) const
+{
+    if (idx < 0 || idx >= static_cast<int>(m_offsets.size())) {
+        return nullptr;
+    }
+
+    const uint64_t offset = m_offsets[idx];
+    if (offset + m_page_bytes > m_size) {
+        return nullptr;
+    }
+    return m_data + offset;
+}
+
+void MappedPageSource::WillNeed(int idx) const
+{
+    auto page = GetPage(idx);
+    if (!page) {
+        return;
+    }
+
+    // hints work on whole os pages
+    static const size_t os_page = os_page_size();
+    const size_t begin = (page - m_data) / os_page * os_page;
+    const size_t end = std::min(page - m_data + m_page_bytes, m_size);
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<uint8_t*>(m_data + begin);
+    range.NumberOfBytes  = end - begin;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    madvise(const_cast<uint8_t*>(m_data + begin), end - begin, MADV_WILLNEED);
+#endif
+}
+
+void MappedPageSource::Map(const std::string& filepath)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    m_file = file;
+
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(file, &sz) || static_cast<uint64_t>(sz.QuadPart) > SIZE_MAX) {
+        Unmap();
+        return;
+    }
+    m_size = static_cast<size_t>(sz.QuadPart);
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        Unmap();
+        return;
+    }
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        Unmap();
+    }
+#else
+    const int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+
+    // the mapping keeps its own reference to the file
+    void* addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        m_size = 0;
+        return;
+    }
+    m_data = static_cast<const uint8_t*>(addr);
+
+    // pages are read all over the file, readahead only wastes io
+    madvise(addr, m_size, MADV_RANDOM);
+#endif
+}
+
+void MappedPageSource::Unmap()
+{
+#ifdef _WIN32
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+    m_mapping = nullptr;
+    m_file    = nullptr;
+#else
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool MappedPageSource::BuildIndex(const textile::VTexInfo& info)
+{
+    // plain or packed layout
+    const bool succ = PageFile::BuildIndex(m_size, info, [&](uint64_t offset, size_t size, void* dst)
+    {
+        if (offset + size > m_size) {
+            return false;
+        }
+        memcpy(dst, m_data + offset, size);
+        return true;
+    }, m_offsets);
+    if (!succ) {
+        m_offsets.clear();
+    }
+    return succ;
+}
+
+}
@@ -1,15 +1,29 @@
 #include "clipmap/PageCache.h"
-#include "clipmap/TextureStack.h"
+#include "clipmap/PageStreamer.h"
+#include "clipmap/MappedPageSource.h"
+#include "clipmap/RamPageCache.h"
+#include "clipmap/PixelConvert.h"
+#include "clipmap/PageFile.h"
+#include "clipmap/EvictPolicy.h"
+#include "clipmap/Stats.h"
+#include "clipmap/UploadBudget.h"
 
 #include <unirender/Device.h>
 #include <unirender/TextureDescription.h>
+#include <unirender/Texture.h>
 #include <textile/PageIndexer.h>
 #include <textile/PageLoader.h>
 
+#include <cmath>
+#include <algorithm>
+
 namespace
 {
 
-const size_t CAPACITY = 256;
+const size_t DEFAULT_CAPACITY = 256;
+
+// reads of a page tried again after a failure before it is given up
+const int MAX_READ_RETRIES = 2;
 
 }
 
@@ -17,84 +31,701 @@ namespace clipmap
 {
 
 PageCache::PageCache(textile::PageLoader& loader, const textile::PageIndexer& indexer,
-                     TextureStack& tex_stack)
+                     size_t budget_bytes)
     : textile::PageCache(loader, indexer)
     , m_indexer(indexer)
-    , m_tex_stack(tex_stack)
 {
     auto& info = loader.GetVTexInfo();
-    m_page_buf = new uint8_t[info.tile_size * info.tile_size * info.channels];
+    assert(info.bytes == 1 || info.bytes == 2);
+    const size_t pixel_count = info.tile_size * info.tile_size;
+    // rgb is expanded to rgba
+    if (info.channels == 3) {
+        m_page_buf = new uint8_t[pixel_count * 4];
+    }
+    if (info.bytes == 2) {
+        m_narrow_buf = new uint8_t[pixel_count * info.channels];
+    }
+
+    switch (info.channels)
+    {
+    case 1:
+        m_block_fmt = BlockCompress::Format::BC4;
+        break;
+    case 2:
+        m_block_fmt = BlockCompress::Format::BC5;
+        break;
+    case 3:
+        m_block_fmt = BlockCompress::Format::BC1;
+        break;
+    case 4:
+        m_block_fmt = BlockCompress::Format::BC3;
+        break;
+    }
+
+    m_req_capacity = budget_bytes == 0 ? DEFAULT_CAPACITY : std::max(budget_bytes / CalcPageBytes(), size_t(1));
+    m_capacity = m_req_capacity;
+
+    m_evict_policy = std::make_shared<LRUEvictPolicy>();
 }
 
 PageCache::~PageCache()
 {
     delete[] m_page_buf;
+    delete[] m_narrow_buf;
+}
+
+void PageCache::Init(const ur::Device& dev)
+{
+    if (m_pool_tex) {
+        return;
+    }
+
+    auto& info = m_loader.GetVTexInfo();
+
+    m_capacity = m_req_capacity;
+    m_pool_n = static_cast<size_t>(std::ceil(std::sqrt(static_cast<float>(m_capacity))));
+
+    // the budget may ask for a pool larger than the device allows
+    const size_t max_n = std::max(static_cast<size_t>(m_max_pool_size) / info.tile_size, size_t(1));
+    if (m_pool_n > max_n)
+    {
+        m_pool_n = max_n;
+        m_capacity = m_pool_n * m_pool_n;
+    }
+
+    ur::TextureDescription desc;
+    desc.target = ur::TextureTarget::Texture2D;
+    desc.width  = info.tile_size * m_pool_n;
+    desc.height = info.tile_size * m_pool_n;
+    if (m_compressed)
+    {
+        switch (m_block_fmt)
+        {
+        case BlockCompress::Format::BC1:
+            desc.format = ur::TextureFormat::COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            break;
+        case BlockCompress::Format::BC3:
+            desc.format = ur::TextureFormat::COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            break;
+        case BlockCompress::Format::BC4:
+            desc.format = ur::TextureFormat::COMPRESSED_RED_RGTC1;
+            break;
+        case BlockCompress::Format::BC5:
+            desc.format = ur::TextureFormat::COMPRESSED_RG_RGTC2;
+            break;
+        }
+    }
+    else
+    {
+        switch (info.channels)
+        {
+        case 1:
+            desc.format = ur::TextureFormat::RED;
+            break;
+        case 3:
+        case 4:
+            desc.format = ur::TextureFormat::RGBA8;
+            break;
+        default:
+            assert(0);
+        }
+    }
+    m_pool_tex = dev.CreateTexture(desc, nullptr);
+
+    m_free_slots.clear();
+    m_free_slots.reserve(m_capacity);
+    for (int i = static_cast<int>(m_capacity) - 1; i >= 0; --i) {
+        m_free_slots.push_back(i);
+    }
+}
+
+void PageCache::SetBudget(const ur::Device& dev, size_t budget_bytes)
+{
+    const size_t capacity = std::max(budget_bytes / CalcPageBytes(), size_t(1));
+    if (capacity == m_req_capacity) {
+        return;
+    }
+
+    m_req_capacity = capacity;
+    m_capacity = capacity;
+    if (m_pool_tex)
+    {
+        ClearPool();
+        m_pool_tex.reset();
+        Init(dev);
+    }
+}
+
+void PageCache::SetMaxPoolSize(const ur::Device& dev, int max_size)
+{
+    if (max_size == m_max_pool_size) {
+        return;
+    }
+
+    m_max_pool_size = max_size;
+    if (m_pool_tex)
+    {
+        ClearPool();
+        m_pool_tex.reset();
+        Init(dev);
+    }
+}
+
+void PageCache::EnableCompression(const ur::Device& dev, bool enable)
+{
+    if (m_compressed == enable) {
+        return;
+    }
+
+    // same budget, more pages
+    const size_t budget = m_req_capacity * CalcPageBytes();
+
+    m_compressed = enable;
+    m_block_buf.resize(enable ? CalcPageBytes() : 0);
+    ResetTranscoder();
+
+    m_req_capacity = std::max(budget / CalcPageBytes(), size_t(1));
+    m_capacity = m_req_capacity;
+
+    if (m_pool_tex)
+    {
+        ClearPool();
+        m_pool_tex.reset();
+        Init(dev);
+    }
+}
+
+void PageCache::AddRef(const textile::Page& page)
+{
+    ++m_page_refs[m_indexer.CalcPageIdx(page)];
+}
+
+void PageCache::Release(const textile::Page& page)
+{
+    auto itr = m_page_refs.find(m_indexer.CalcPageIdx(page));
+    assert(itr != m_page_refs.end() && itr->second > 0);
+    if (--itr->second == 0) {
+        m_page_refs.erase(itr);
+    }
+}
+
+int PageCache::GetRefCount(const textile::Page& page) const
+{
+    auto itr = m_page_refs.find(m_indexer.CalcPageIdx(page));
+    return itr == m_page_refs.end() ? 0 : itr->second;
+}
+
+void PageCache::SetEvictPolicy(const std::shared_ptr<EvictPolicy>& policy)
+{
+    m_evict_policy = policy ? policy : std::make_shared<LRUEvictPolicy>();
+}
+
+void PageCache::SetMipQuota(int mip, size_t max_pages)
+{
+    assert(mip >= 0);
+    if (mip >= static_cast<int>(m_mip_quota.size())) {
+        m_mip_quota.resize(mip + 1, 0);
+    }
+    m_mip_quota[mip] = max_pages;
 }
 
 void PageCache::LoadComplete(const ur::Device& dev, const textile::Page& page, const uint8_t* data)
 {
-    if (m_lru.Size() == CAPACITY)
+    // read from the file
+    if (m_ram_cache) {
+        m_ram_cache->Insert(m_indexer.CalcPageIdx(page), data);
+    }
+    InsertPage(dev, page, data, false);
+}
+
+void PageCache::InsertPage(const ur::Device& dev, const textile::Page& page,
+                           const uint8_t* data, bool encoded)
+{
+    if (!m_pool_tex) {
+        Init(dev);
+    }
+
+    const int idx = m_indexer.CalcPageIdx(page);
+    if (m_map_page2entry.find(idx) != m_map_page2entry.end()
+     || m_uniform_pages.find(idx) != m_uniform_pages.end()) {
+        return;
+    }
+
+    // ocean, snow or padding, written to the layers as a fill
+    uint32_t color = 0;
+    if (CalcUniformColor(data, encoded, color))
+    {
+        m_uniform_pages.insert({ idx, color });
+        CLIPMAP_STAT_ADD(CurrStats(), pages_uniform, 1);
+        return;
+    }
+
+    if (page.mip >= static_cast<int>(m_mip_count.size())) {
+        m_mip_count.resize(page.mip + 1, 0);
+    }
+
+    // per-mip quota first, so fine levels only replace their own pages
+    const size_t quota = page.mip < static_cast<int>(m_mip_quota.size()) ? m_mip_quota[page.mip] : 0;
+    if (quota > 0 && m_mip_count[page.mip] >= quota)
+    {
+        for (auto itr = m_lru_list.rbegin(); itr != m_lru_list.rend(); ++itr) {
+            if (itr->mip == page.mip) {
+                Evict(std::prev(itr.base()));
+                break;
+            }
+        }
+    }
+    if (m_free_slots.empty()) {
+        Evict(SelectVictim());
+    }
+
+    assert(!m_free_slots.empty());
+    const int slot = m_free_slots.back();
+    m_free_slots.pop_back();
+
+    m_lru_list.push_front(page);
+
+    Entry entry;
+    entry.slot    = slot;
+    entry.lru_itr = m_lru_list.begin();
+    m_map_page2entry.insert({ idx, entry });
+    ++m_mip_count[page.mip];
+
+    UploadPage(slot, data, encoded);
+}
+
+PageCache::PageSlot PageCache::QueryPageTex(const textile::Page& page) const
+{
+    const int idx = m_indexer.CalcPageIdx(page);
+    auto itr = m_map_page2entry.find(idx);
+    if (itr != m_map_page2entry.end()) {
+        return CalcSlot(itr->second.slot);
+    }
+
+    PageSlot ret;
+    auto uniform_itr = m_uniform_pages.find(idx);
+    if (uniform_itr != m_uniform_pages.end())
+    {
+        ret.uniform = true;
+        ret.color = uniform_itr->second;
+    }
+    return ret;
+}
+
+bool PageCache::EnableStreaming(const std::string& filepath, size_t thread_num)
+{
+    auto streamer = std::make_unique<PageStreamer>(
+        filepath, m_loader.GetVTexInfo(), m_indexer, thread_num
+    );
+    if (!streamer->IsValid()) {
+        return false;
+    }
+
+    m_streamer = std::move(streamer);
+    m_read_failures.clear();
+    m_streamer->SetPageSource(m_mapping);
+    m_streamer->SetRamCache(m_ram_cache);
+    ResetTranscoder();
+    return true;
+}
+
+void PageCache::EnableRamCache(size_t budget_bytes)
+{
+    if (budget_bytes == 0)
+    {
+        m_ram_cache.reset();
+        m_ram_buf.clear();
+    }
+    else if (m_ram_cache)
+    {
+        m_ram_cache->SetBudget(budget_bytes);
+    }
+    else
+    {
+        auto& info = m_loader.GetVTexInfo();
+        const size_t page_bytes = info.tile_size * info.tile_size * info.channels * info.bytes;
+        m_ram_cache = std::make_shared<RamPageCache>(page_bytes, budget_bytes);
+        m_ram_buf.resize(page_bytes);
+    }
+
+    if (m_streamer) {
+        m_streamer->SetRamCache(m_ram_cache);
+    }
+}
+
+bool PageCache::EnableMapping(const std::string& filepath)
+{
+    auto mapping = std::make_shared<MappedPageSource>(filepath, m_loader.GetVTexInfo());
+    if (!mapping->IsOpen()) {
+        return false;
+    }
+
+    m_mapping = mapping;
+    if (m_streamer) {
+        m_streamer->SetPageSource(m_mapping);
+    }
+    return true;
+}
+
+bool PageCache::Fetch(const ur::Device& dev, const textile::Page& page)
+{
+    const int idx = m_indexer.CalcPageIdx(page);
+    auto itr = m_map_page2entry.find(idx);
+    if (itr != m_map_page2entry.end())
+    {
+        // touch
+        m_lru_list.splice(m_lru_list.begin(), m_lru_list, itr->second.lru_itr);
+        CLIPMAP_STAT_ADD(CurrStats(), cache_hits, 1);
+        return true;
+    }
+    if (m_uniform_pages.find(idx) != m_uniform_pages.end())
     {
-        auto end = m_lru.GetListEnd();
-        assert(end);
-        m_map_page2tex.erase(m_indexer.CalcPageIdx(end->page));
-        m_lru.RemoveBack();
+        CLIPMAP_STAT_ADD(CurrStats(), cache_hits, 1);
+        return true;
     }
 
-    m_lru.AddFront(page, 0, 0);
+    CLIPMAP_STAT_ADD(CurrStats(), cache_misses, 1);
 
-    m_map_page2tex.insert({
-        m_indexer.CalcPageIdx(page),
-        CreatePageTex(dev, data)
+    if (m_streamer) {
+        if (IsReadGivenUp(idx)) {
+            return false;
+        }
+        if (m_streamer->Submit(page)) {
+            CLIPMAP_STAT_ADD(CurrStats(), pages_requested, 1);
+        }
+        return false;
+    }
+
+    // loads synchronously, ends in LoadComplete()
+    CLIPMAP_STAT_ADD(CurrStats(), pages_requested, 1);
+    if (m_mapping)
+    {
+        if (auto data = m_mapping->GetPage(m_indexer.CalcPageIdx(page))) {
+            InsertPage(dev, page, data, false);
+        }
+    }
+    else if (m_ram_cache && m_ram_cache->Lookup(m_indexer.CalcPageIdx(page), m_ram_buf.data()))
+    {
+        InsertPage(dev, page, m_ram_buf.data(), false);
+    }
+    else
+    {
+        Request(dev, page);
+    }
+    return QueryPageTex(page).IsValid();
+}
+
+size_t PageCache::Flush(const ur::Device& dev, std::function<void(const textile::Page& page)> cb,
+                        UploadBudget* budget, size_t max_num)
+{
+    if (!m_streamer) {
+        return 0;
+    }
+
+    // no view shows them any more
+    const size_t cancelled = m_streamer->Cancel([&](const textile::Page& page) {
+        return GetRefCount(page) == 0;
     });
+    CLIPMAP_STAT_ADD(CurrStats(), pages_cancelled, cancelled);
+
+    // encoded for a pool that has since been switched to raw pages
+    std::vector<textile::Page> stale;
+
+    auto insert = [&](const textile::Page& page, const uint8_t* data, bool transcoded)
+    {
+        if (QueryPageTex(page).IsValid()) {
+            return;
+        }
+        if (transcoded && !m_compressed) {
+            stale.push_back(page);
+            return;
+        }
+        InsertPage(dev, page, data, transcoded);
+        if (budget) {
+            budget->Consume(QueryPageTex(page).uniform ? 0 : CalcPageBytes());
+        }
+        if (!m_read_failures.empty()) {
+            m_read_failures.erase(m_indexer.CalcPageIdx(page));
+        }
+        cb(page);
+    };
+
+    std::vector<textile::Page> failed;
+    auto on_fail = [&](const textile::Page& page) {
+        failed.push_back(page);
+    };
+
+    size_t polled = 0;
+    if (!budget || budget->IsUnlimited())
+    {
+        polled = m_streamer->Poll(insert, max_num, on_fail);
+    }
+    else
+    {
+        while (!budget->IsExhausted() && (max_num == 0 || polled < max_num)
+            && m_streamer->Poll(insert, 1, on_fail) > 0) {
+            ++polled;
+        }
+    }
+
+    // read again, no longer in flight once polled
+    for (auto& page : stale) {
+        m_streamer->Submit(page);
+    }
+
+    // read again while a view shows them, then given up for good, so the
+    // views stop asking for pages a damaged file can't give
+    for (auto& page : failed)
+    {
+        const int idx = m_indexer.CalcPageIdx(page);
+        if (GetRefCount(page) == 0) {
+            m_read_failures.erase(idx);
+            continue;
+        }
+        if (++m_read_failures[idx] <= MAX_READ_RETRIES) {
+            m_streamer->Submit(page);
+            continue;
+        }
+        CLIPMAP_STAT_ADD(CurrStats(), pages_failed, 1);
+    }
+
+    return polled;
+}
+
+bool PageCache::IsReadGivenUp(int idx) const
+{
+    if (m_read_failures.empty()) {
+        return false;
+    }
+    auto itr = m_read_failures.find(idx);
+    return itr != m_read_failures.end() && itr->second > MAX_READ_RETRIES;
+}
+
+void PageCache::Prefetch(const textile::Page& page)
+{
+    if (m_streamer && !QueryPageTex(page).IsValid() && !IsReadGivenUp(m_indexer.CalcPageIdx(page))) {
+        m_streamer->Submit(page, true);
+    }
+}
+
+void PageCache::CancelPrefetch()
+{
+    if (m_streamer) {
+        m_streamer->CancelPrefetch();
+    }
+}
+
+void PageCache::SetPrefetchBudget(size_t budget)
+{
+    if (m_streamer) {
+        m_streamer->SetPrefetchBudget(budget);
+    }
 }
 
-ur::TexturePtr PageCache::QueryPageTex(const textile::Page& page) const
+void PageCache::SetMaxLoadsInFlight(size_t max_num)
 {
-    auto itr = m_map_page2tex.find(m_indexer.CalcPageIdx(page));
-    return itr == m_map_page2tex.end() ? nullptr : itr->second;
+    if (m_streamer) {
+        m_streamer->SetMaxInFlight(max_num);
+    }
 }
 
-ur::TexturePtr PageCache::CreatePageTex(const ur::Device& dev, const uint8_t* data) const
+bool PageCache::IsLoadQueueFull() const
+{
+    return m_streamer && m_streamer->IsFull();
+}
+
+void PageCache::UploadPage(int slot, const uint8_t* data, bool encoded)
 {
     auto& info = m_loader.GetVTexInfo();
-    assert(info.bytes == 1);
-    auto dst = m_page_buf;
-    memset(dst, 0xff, info.tile_size * info.tile_size * info.channels);
-    const uint8_t* src = data;
-    for (size_t y = 0; y < info.tile_size; ++y) {
-        for (size_t x = 0; x < info.tile_size; ++x) {
-            memset(&dst[(y * info.tile_size + x) * info.channels], 0xff, info.channels);
-            for (size_t c = 0; c < info.channels; ++c) {
-                auto s_idx = (y * info.tile_size + x) * info.channels + c;
-                auto d_idx = (y * info.tile_size + x) * info.channels + c;
-                dst[d_idx] = src[s_idx];
-            }
+    const int sz = static_cast<int>(info.tile_size);
+
+    // upload loader's buffer directly when layout matches the pool
+    const uint8_t* pixels = data;
+    if (!encoded)
+    {
+        if (m_compressed)
+        {
+            // only pages loaded before the streaming workers took over
+            // encoding, not worth a thread pool on the render thread
+            EncodePage(data, m_narrow_buf, m_page_buf, m_block_buf.data());
+            pixels = m_block_buf.data();
+        }
+        else
+        {
+            pixels = ConvertPage(data, m_narrow_buf, m_page_buf);
         }
     }
 
-    //auto tex = std::make_shared<ur::Texture>();
+    const int x = static_cast<int>(slot % m_pool_n * info.tile_size);
+    const int y = static_cast<int>(slot / m_pool_n * info.tile_size);
+    m_pool_tex->Upload(pixels, x, y, sz, sz, 0, 1);
 
-    ur::TextureDescription desc;
-    desc.target = ur::TextureTarget::Texture2D;
-    desc.width = info.tile_size;
-    desc.height = info.tile_size;
-    switch (info.channels)
+    CLIPMAP_STAT_ADD(CurrStats(), pages_uploaded, 1);
+    CLIPMAP_STAT_ADD(CurrStats(), bytes_uploaded, CalcPageBytes());
+    CLIPMAP_STAT_ADD(CurrStats(), bytes_source, PageFile::CalcPageBytes(info));
+}
+
+bool PageCache::CalcUniformColor(const uint8_t* data, bool encoded, uint32_t& color) const
+{
+    auto& info = m_loader.GetVTexInfo();
+
+    uint8_t rgba[4] = { 0, 0, 0, 0xff };
+    if (encoded)
     {
-    case 1:
-        desc.format = ur::TextureFormat::RED;
-        break;
-    case 3:
-        desc.format = ur::TextureFormat::RGB;
-        break;
-    case 4:
-        desc.format = ur::TextureFormat::RGBA8;
-        break;
-    default:
-        assert(0);
+        // identical blocks, the colour is what the pool would have shown
+        if (!PixelConvert::IsUniform(data, CalcPageBytes(), BlockCompress::BlockBytes(m_block_fmt))) {
+            return false;
+        }
+        // and one colour inside the block, not just the same gradient
+        uint8_t block[16 * 4];
+        BlockCompress::Decode(m_block_fmt, data, 4, 4, block);
+        const int block_ch = BlockCompress::SrcChannels(m_block_fmt);
+        if (!PixelConvert::IsUniform(block, 16 * block_ch, block_ch)) {
+            return false;
+        }
+        for (int c = 0; c < block_ch; ++c) {
+            rgba[c] = block[c];
+        }
+    }
+    else
+    {
+        const size_t pixel_bytes = info.channels * info.bytes;
+        if (!PixelConvert::IsUniform(data, info.tile_size * info.tile_size * pixel_bytes, pixel_bytes)) {
+            return false;
+        }
+        // same narrowing as ConvertPage()
+        for (int c = 0; c < static_cast<int>(info.channels); ++c) {
+            rgba[c] = info.bytes == 2 ? data[c * 2 + 1] : data[c];
+        }
+    }
+
+    color = rgba[0] | (rgba[1] << 8) | (rgba[2] << 16) | (static_cast<uint32_t>(rgba[3]) << 24);
+    return true;
+}
+
+const uint8_t* PageCache::ConvertPage(const uint8_t* data, uint8_t* narrow_buf,
+                                      uint8_t* page_buf) const
+{
+    auto& info = m_loader.GetVTexInfo();
+    const size_t pixel_count = info.tile_size * info.tile_size;
+
+    const uint8_t* pixels = data;
+    if (info.bytes == 2)
+    {
+        PixelConvert::U16ToU8(reinterpret_cast<const uint16_t*>(pixels), narrow_buf, pixel_count * info.channels);
+        pixels = narrow_buf;
+    }
+    if (info.channels == 3)
+    {
+        PixelConvert::RGB2RGBA(pixels, page_buf, pixel_count);
+        pixels = page_buf;
+    }
+    return pixels;
+}
+
+void PageCache::EncodePage(const uint8_t* data, uint8_t* narrow_buf, uint8_t* page_buf,
+                           uint8_t* dst) const
+{
+    auto& info = m_loader.GetVTexInfo();
+    const int sz = static_cast<int>(info.tile_size);
+    auto pixels = ConvertPage(data, narrow_buf, page_buf);
+    BlockCompress::Encode(m_block_fmt, pixels, sz, sz, dst);
+}
+
+void PageCache::ResetTranscoder()
+{
+    if (!m_streamer) {
+        return;
+    }
+
+    if (!m_compressed) {
+        m_streamer->SetTranscoder(nullptr);
+        return;
     }
 
-    return dev.CreateTexture(desc, m_page_buf);
+    // runs on the workers, so with its own scratch. the size is taken
+    // now, m_compressed may change while a worker is encoding
+    const size_t page_bytes = CalcPageBytes();
+    m_streamer->SetTranscoder([this, page_bytes](const uint8_t* src, std::vector<uint8_t>& dst)
+    {
+        auto& info = m_loader.GetVTexInfo();
+        const size_t pixel_count = info.tile_size * info.tile_size;
+
+        thread_local std::vector<uint8_t> narrow_buf, page_buf;
+        narrow_buf.resize(pixel_count * info.channels);
+        page_buf.resize(pixel_count * 4);
+
+        dst.resize(page_bytes);
+        EncodePage(src, narrow_buf.data(), page_buf.data(), dst.data());
+    });
+}
+
+std::list<textile::Page>::const_iterator PageCache::SelectVictim() const
+{
+    auto victim = m_evict_policy->SelectVictim(m_lru_list);
+    if (m_page_refs.empty() || GetRefCount(*victim) == 0) {
+        return victim;
+    }
+
+    // some view still shows it, take the oldest page no view shows
+    for (auto itr = m_lru_list.rbegin(); itr != m_lru_list.rend(); ++itr) {
+        if (GetRefCount(*itr) == 0) {
+            return std::prev(itr.base());
+        }
+    }
+    return victim;
+}
+
+void PageCache::Evict(std::list<textile::Page>::const_iterator itr)
+{
+    assert(itr != m_lru_list.end());
+    auto entry = m_map_page2entry.find(m_indexer.CalcPageIdx(*itr));
+    assert(entry != m_map_page2entry.end());
+
+    m_free_slots.push_back(entry->second.slot);
+    --m_mip_count[itr->mip];
+
+    m_map_page2entry.erase(entry);
+    m_lru_list.erase(itr);
+
+    CLIPMAP_STAT_ADD(CurrStats(), evictions, 1);
+}
+
+void PageCache::ClearPool()
+{
+    m_lru_list.clear();
+    m_map_page2entry.clear();
+    m_uniform_pages.clear();
+    m_mip_count.clear();
+    m_free_slots.clear();
+}
+
+PageCache::PageSlot PageCache::CalcSlot(int slot) const
+{
+    PageSlot ret;
+    ret.idx = slot;
+
+    const float sz = 1.0f / m_pool_n;
+    ret.uv.xmin = (slot % m_pool_n) * sz;
+    ret.uv.ymin = (slot / m_pool_n) * sz;
+    ret.uv.xmax = ret.uv.xmin + sz;
+    ret.uv.ymax = ret.uv.ymin + sz;
+
+    return ret;
+}
+
+size_t PageCache::CalcPageBytes() const
+{
+    auto& info = m_loader.GetVTexInfo();
+    if (m_compressed) {
+        return BlockCompress::CalcSize(m_block_fmt, static_cast<int>(info.tile_size), static_cast<int>(info.tile_size));
+    }
+    return info.tile_size * info.tile_size * (info.channels == 1 ? 1 : 4);
+}
+
+FrameStats* PageCache::CurrStats() const
+{
+    return m_stats ? m_stats->GetCurrFrame() : nullptr;
 }
 
 }
\ No newline at end of file
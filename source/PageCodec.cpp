@@ -0,0 +1,197 @@
+#include "clipmap/PageCodec.h"
+
+#include <string.h>
+
+namespace
+{
+
+const int HASH_BITS = 12;
+
+const size_t MIN_MATCH = 4;
+// format limits, the last literals and the tail a match may not start in
+const size_t LAST_LITERALS = 5;
+const size_t MF_LIMIT      = 12;
+
+const size_t MAX_OFFSET = 65535;
+
+uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+uint32_t hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// 15 in the token, then 255s and the rest
+uint8_t* write_length(uint8_t* op, size_t len)
+{
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+bool read_length(const uint8_t*& ip, const uint8_t* end, size_t& len)
+{
+    uint8_t b;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+uint8_t* write_sequence(uint8_t* op, const uint8_t* lit, size_t lit_len,
+                        size_t offset, size_t match_len)
+{
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) {
+        op = write_length(op, lit_len - 15);
+    }
+    // empty pages may come with null buffers
+    if (lit_len > 0) {
+        memcpy(op, lit, lit_len);
+    }
+    op += lit_len;
+
+    // last literals have no match
+    if (match_len == 0) {
+        return op;
+    }
+
+    *op++ = static_cast<uint8_t>(offset & 0xff);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+
+    const size_t ml = match_len - MIN_MATCH;
+    *token |= static_cast<uint8_t>(ml < 15 ? ml : 15);
+    if (ml >= 15) {
+        op = write_length(op, ml - 15);
+    }
+    return op;
+}
+
+}
+
+namespace clipmap
+{
+
+size_t PageCodec::CalcBound(size_t src_size)
+{
+    return src_size + src_size / 255 + 16;
+}
+
+size_t PageCodec::Compress(const uint8_t* src, size_t src_size, uint8_t* dst)
+{
+    uint8_t* op = dst;
+    size_t anchor = 0;
+
+    if (src_size > MF_LIMIT)
+    {
+        // position + 1, 0 for empty
+        uint32_t table[1 << HASH_BITS];
+        memset(table, 0, sizeof(table));
+
+        const size_t match_limit = src_size - MF_LIMIT;
+        const size_t end_limit   = src_size - LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < match_limit)
+        {
+            const uint32_t seq = read32(src + ip);
+            const uint32_t h = hash(seq);
+            const size_t ref = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+
+            if (ref == 0 || ip - (ref - 1) > MAX_OFFSET || read32(src + ref - 1) != seq) {
+                ++ip;
+                continue;
+            }
+
+            const size_t match = ref - 1;
+            size_t len = MIN_MATCH;
+            while (ip + len < end_limit && src[match + len] == src[ip + len]) {
+                ++len;
+            }
+
+            op = write_sequence(op, src + anchor, ip - anchor, ip - match, len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence(op, src + anchor, src_size - anchor, 0, 0);
+    return op - dst;
+}
+
+bool PageCodec::Decompress(const uint8_t* src, size_t src_size,
+                           uint8_t* dst, size_t dst_size)
+{
+    const uint8_t* ip = src;
+    const uint8_t* const ip_end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* const op_end = dst + dst_size;
+
+    while (ip < ip_end)
+    {
+        const uint8_t token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !read_length(ip, ip_end, lit_len)) {
+            return false;
+        }
+        if (lit_len > static_cast<size_t>(ip_end - ip) || lit_len > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+        if (lit_len > 0) {
+            memcpy(op, ip, lit_len);
+        }
+        ip += lit_len;
+        op += lit_len;
+
+        // last sequence
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return false;
+        }
+        const size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+            return false;
+        }
+
+        size_t match_len = token & 0xf;
+        if (match_len == 15 && !read_length(ip, ip_end, match_len)) {
+            return false;
+        }
+        match_len += MIN_MATCH;
+        if (match_len > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+
+        // may overlap, copy forward byte by byte
+        const uint8_t* match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+        } else {
+            for (size_t i = 0; i < match_len; ++i) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op == op_end;
+}
+
+}
@@ -0,0 +1,158 @@
+#include "clipmap/PageFile.h"
+#include "clipmap/PageStreamer.h"
+
+#include <textile/PageIndexer.h>
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+#include <string.h>
+
+namespace
+{
+
+// spread the low 32 bits to the even bits
+uint64_t part_1by1(uint64_t v)
+{
+    v &= 0xffffffff;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+    v = (v | (v << 8))  & 0x00ff00ff00ff00ffull;
+    v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v << 2))  & 0x3333333333333333ull;
+    v = (v | (v << 1))  & 0x5555555555555555ull;
+    return v;
+}
+
+}
+
+namespace clipmap
+{
+
+static_assert(sizeof(PageFile::Footer) == 48, "footer is written as is");
+
+bool PageFile::BuildIndex(size_t file_size, const textile::VTexInfo& info,
+                          const ReadAt& read_at, std::vector<uint64_t>& offsets)
+{
+    const size_t page_count = PageStreamer::CalcPageCount(info);
+    const size_t page_bytes = CalcPageBytes(info);
+
+    uint8_t tail[sizeof(Footer)];
+    Footer footer;
+    if (file_size >= sizeof(Footer)
+     && read_at(file_size - sizeof(Footer), sizeof(Footer), tail)
+     && ReadFooter(tail, file_size, footer))
+    {
+        const bool match = footer.page_count == page_count
+            && footer.vtex_width == info.vtex_width
+            && footer.vtex_height == info.vtex_height
+            && footer.tile_size == info.tile_size
+            && footer.channels == info.channels
+            && footer.bytes == info.bytes;
+        if (!match) {
+            return false;
+        }
+
+        offsets.resize(page_count);
+        return read_at(footer.index_offset, page_count * sizeof(uint64_t), offsets.data());
+    }
+
+    // plain, pages are stored after the header in page index order
+    const size_t data_sz = page_count * page_bytes;
+    if (file_size < data_sz) {
+        return false;
+    }
+    const uint64_t data_offset = file_size - data_sz;
+
+    offsets.resize(page_count);
+    for (size_t i = 0; i < page_count; ++i) {
+        offsets[i] = data_offset + i * page_bytes;
+    }
+    return true;
+}
+
+bool PageFile::IsPacked(const std::string& filepath)
+{
+    std::ifstream fin(filepath, std::ios::binary | std::ios::ate);
+    if (!fin.is_open()) {
+        return false;
+    }
+
+    const size_t file_size = static_cast<size_t>(fin.tellg());
+    if (file_size < sizeof(Footer)) {
+        return false;
+    }
+
+    uint8_t tail[sizeof(Footer)];
+    fin.seekg(file_size - sizeof(Footer));
+    fin.read(reinterpret_cast<char*>(tail), sizeof(Footer));
+
+    Footer footer;
+    return fin.gcount() == sizeof(Footer) && ReadFooter(tail, file_size, footer);
+}
+
+bool PageFile::ReadFooter(const uint8_t* tail, size_t file_size, Footer& footer)
+{
+    memcpy(&footer, tail, sizeof(Footer));
+    if (footer.magic != MAGIC || footer.version != VERSION) {
+        return false;
+    }
+    return footer.index_offset + footer.page_count * sizeof(uint64_t) + sizeof(Footer) <= file_size;
+}
+
+void PageFile::InitFooter(const textile::VTexInfo& info, uint64_t index_offset, Footer& footer)
+{
+    footer = Footer();
+    footer.index_offset = index_offset;
+    footer.page_count   = PageStreamer::CalcPageCount(info);
+    footer.vtex_width   = static_cast<uint32_t>(info.vtex_width);
+    footer.vtex_height  = static_cast<uint32_t>(info.vtex_height);
+    footer.tile_size    = static_cast<uint32_t>(info.tile_size);
+    footer.channels     = static_cast<uint32_t>(info.channels);
+    footer.bytes        = static_cast<uint32_t>(info.bytes);
+}
+
+uint64_t PageFile::MortonCode(uint32_t x, uint32_t y)
+{
+    return part_1by1(x) | (part_1by1(y) << 1);
+}
+
+void PageFile::CalcPackedOrder(const textile::VTexInfo& info, std::vector<uint64_t>& ranks)
+{
+    textile::PageIndexer indexer(info);
+
+    const size_t page_count = PageStreamer::CalcPageCount(info);
+    ranks.assign(page_count, 0);
+
+    size_t w = info.PageTableWidth();
+    size_t h = info.PageTableHeight();
+    const auto mip_count = static_cast<int>(std::log2(std::min(w, h))) + 1;
+
+    // levels one after another, the pages of a level along the z curve
+    uint64_t next = 0;
+    std::vector<std::pair<uint64_t, size_t>> codes;
+    for (int mip = 0; mip < mip_count; ++mip)
+    {
+        codes.clear();
+        codes.reserve(w * h);
+        for (size_t y = 0; y < h; ++y) {
+            for (size_t x = 0; x < w; ++x) {
+                const textile::Page page(static_cast<int>(x), static_cast<int>(y), mip);
+                const size_t idx = static_cast<size_t>(indexer.CalcPageIdx(page));
+                if (idx < page_count) {
+                    codes.push_back({ MortonCode(static_cast<uint32_t>(x), static_cast<uint32_t>(y)), idx });
+                }
+            }
+        }
+        // page tables need not be square or powers of two, so rank the codes
+        std::sort(codes.begin(), codes.end());
+        for (auto& c : codes) {
+            ranks[c.second] = next++;
+        }
+
+        w = std::max(w / 2, size_t(1));
+        h = std::max(h / 2, size_t(1));
+    }
+}
+
+}
@@ -0,0 +1,66 @@
+#include "clipmap/PageService.h"
+#include "clipmap/TextureStack.h"
+#include "clipmap/PageFile.h"
+
+#include <algorithm>
+
+#include <assert.h>
+
+namespace clipmap
+{
+
+PageService::PageService(const std::string& filepath, const textile::VTexInfo& info,
+                         size_t io_thread_num, size_t cache_budget)
+    : m_filepath(filepath)
+    , m_info(info)
+    , m_indexer(m_info)
+    , m_loader(filepath, m_indexer)
+    , m_cache(m_loader, m_indexer, cache_budget)
+{
+    // textile::PageLoader only reads plain files, packed pages need the
+    // offset index of the mapping or the streaming workers
+    const bool packed = PageFile::IsPacked(filepath);
+    if (packed && io_thread_num == 0 && !m_cache.EnableMapping(filepath)) {
+        io_thread_num = 1;
+    }
+
+    if (io_thread_num > 0 && !m_cache.EnableStreaming(filepath, io_thread_num)) {
+        // plain files go on with textile::PageLoader
+        m_valid = !packed || m_cache.IsMapped();
+    }
+}
+
+void PageService::Init(const ur::Device& dev)
+{
+    m_cache.Init(dev);
+}
+
+void PageService::AddView(TextureStack& stack)
+{
+    assert(std::find(m_views.begin(), m_views.end(), &stack) == m_views.end());
+    m_views.push_back(&stack);
+}
+
+void PageService::RemoveView(TextureStack& stack)
+{
+    auto itr = std::find(m_views.begin(), m_views.end(), &stack);
+    if (itr == m_views.end()) {
+        return;
+    }
+
+    stack.ReleasePageRefs(m_cache);
+    m_views.erase(itr);
+}
+
+size_t PageService::Flush(const ur::Device& dev, UploadBudget* budget, size_t max_num)
+{
+    return m_cache.Flush(dev, [&](const textile::Page& page)
+    {
+        const auto slot = m_cache.QueryPageTex(page);
+        for (auto& view : m_views) {
+            view->AddLoadedPage(page, slot);
+        }
+    }, budget, max_num);
+}
+
+}
@@ -0,0 +1,360 @@
+#include "clipmap/PageStreamer.h"
+#include "clipmap/MappedPageSource.h"
+#include "clipmap/RamPageCache.h"
+#include "clipmap/PageFile.h"
+
+#include <textile/PageIndexer.h>
+
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+
+namespace clipmap
+{
+
+PageStreamer::PageStreamer(const std::string& filepath, const textile::VTexInfo& info,
+                           const textile::PageIndexer& indexer, size_t thread_num)
+    : m_filepath(filepath)
+    , m_info(info)
+    , m_indexer(indexer)
+{
+    m_page_bytes = info.tile_size * info.tile_size * info.channels * info.bytes;
+
+    // plain or packed layout
+    std::ifstream fin(m_filepath, std::ios::binary | std::ios::ate);
+    if (fin.is_open())
+    {
+        const size_t file_sz = static_cast<size_t>(fin.tellg());
+        const bool succ = PageFile::BuildIndex(file_sz, info, [&](uint64_t offset, size_t size, void* dst)
+        {
+            fin.seekg(offset);
+            fin.read(static_cast<char*>(dst), size);
+            return static_cast<size_t>(fin.gcount()) == size;
+        }, m_offsets);
+        if (!succ) {
+            m_offsets.clear();
+        }
+    }
+
+    thread_num = std::max(thread_num, size_t(1));
+
+    // enough to keep the workers busy between two frames
+    m_max_in_flight = thread_num * 4;
+
+    m_threads.reserve(thread_num);
+    for (size_t i = 0; i < thread_num; ++i) {
+        m_threads.emplace_back(&PageStreamer::WorkerLoop, this);
+    }
+}
+
+PageStreamer::~PageStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_requests.clear();
+        m_prefetch_requests.clear();
+    }
+    m_cond.notify_all();
+
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+bool PageStreamer::Submit(const textile::Page& page, bool prefetch)
+{
+    const int idx = m_indexer.CalcPageIdx(page);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Request req;
+        req.page = page;
+        req.idx  = idx;
+
+        if (!m_pending.insert(idx).second)
+        {
+            if (prefetch) {
+                return false;
+            }
+
+            // became visible while waiting as prefetch, promote it
+            auto itr = std::find_if(m_prefetch_requests.begin(), m_prefetch_requests.end(),
+                [idx](const Request& r) { return r.idx == idx; });
+            if (itr == m_prefetch_requests.end()) {
+                return false;
+            }
+            m_prefetch_requests.erase(itr);
+            PushRequest(req);
+        }
+        else if (prefetch)
+        {
+            if (m_prefetch_requests.size() + m_prefetch_running >= m_prefetch_budget) {
+                m_pending.erase(idx);
+                return false;
+            }
+            m_prefetch_requests.push_back(req);
+
+            // the os reads it in while the page waits in the queue
+            if (m_source) {
+                m_source->WillNeed(idx);
+            }
+        }
+        else
+        {
+            PushRequest(req);
+        }
+    }
+    m_cond.notify_one();
+
+    return true;
+}
+
+void PageStreamer::SetTranscoder(const Transcoder& transcoder)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_transcoder = transcoder;
+}
+
+void PageStreamer::SetPageSource(const std::shared_ptr<MappedPageSource>& source)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_source = source && source->IsOpen() ? source : nullptr;
+}
+
+void PageStreamer::SetRamCache(const std::shared_ptr<RamPageCache>& cache)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ram_cache = cache;
+}
+
+void PageStreamer::CancelPrefetch()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& req : m_prefetch_requests) {
+        m_pending.erase(req.idx);
+    }
+    m_prefetch_requests.clear();
+}
+
+size_t PageStreamer::Cancel(std::function<bool(const textile::Page& page)> is_stale)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto end = std::remove_if(m_requests.begin(), m_requests.end(), [&](const Request& req) {
+        return is_stale(req.page);
+    });
+    for (auto itr = end; itr != m_requests.end(); ++itr) {
+        m_pending.erase(itr->idx);
+    }
+    const size_t num = std::distance(end, m_requests.end());
+    m_requests.erase(end, m_requests.end());
+    return num;
+}
+
+void PageStreamer::SetMaxInFlight(size_t max_num)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_in_flight = max_num;
+}
+
+bool PageStreamer::IsFull() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_max_in_flight > 0 && m_requests.size() + m_visible_running >= m_max_in_flight;
+}
+
+size_t PageStreamer::Poll(Callback cb, size_t max_num, FailCallback on_fail)
+{
+    std::vector<Result> completed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_completed.empty()) {
+            return 0;
+        }
+        if (max_num == 0 || max_num >= m_completed.size())
+        {
+            completed.swap(m_completed);
+        }
+        else
+        {
+            // oldest first, the rest wait for the next poll
+            auto end = m_completed.begin() + max_num;
+            completed.assign(std::make_move_iterator(m_completed.begin()), std::make_move_iterator(end));
+            m_completed.erase(m_completed.begin(), end);
+        }
+    }
+
+    for (auto& r : completed)
+    {
+        if (r.succ) {
+            cb(r.page, r.mapped ? r.mapped : r.data.data(), r.transcoded);
+        } else if (on_fail) {
+            on_fail(r.page);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& r : completed)
+    {
+        m_pending.erase(r.idx);
+        if (r.data.capacity() > 0) {
+            m_free_bufs.push_back(std::move(r.data));
+        }
+    }
+
+    return completed.size();
+}
+
+void PageStreamer::Drain(Callback cb, FailCallback on_fail)
+{
+    while (true)
+    {
+        Poll(cb, 0, on_fail);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_pending.empty()) {
+            return;
+        }
+        m_done_cond.wait(lock, [&] { return !m_completed.empty(); });
+    }
+}
+
+bool PageStreamer::IsPending(const textile::Page& page) const
+{
+    const int idx = m_indexer.CalcPageIdx(page);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending.find(idx) != m_pending.end();
+}
+
+void PageStreamer::WorkerLoop()
+{
+    std::ifstream fin(m_filepath, std::ios::binary);
+
+    std::vector<uint8_t> trans_buf;
+    while (true)
+    {
+        Result ret;
+        Transcoder transcoder = nullptr;
+        std::shared_ptr<MappedPageSource> source = nullptr;
+        std::shared_ptr<RamPageCache> ram_cache = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [&] {
+                return m_stop || !m_requests.empty() || CanStartPrefetch();
+            });
+            if (m_stop) {
+                return;
+            }
+
+            // visible pages first
+            auto& queue = m_requests.empty() ? m_prefetch_requests : m_requests;
+            ret.page     = queue.front().page;
+            ret.idx      = queue.front().idx;
+            ret.prefetch = &queue == &m_prefetch_requests;
+            queue.pop_front();
+            if (ret.prefetch) {
+                ++m_prefetch_running;
+            } else {
+                ++m_visible_running;
+            }
+            transcoder = m_transcoder;
+            source = m_source;
+            ram_cache = m_ram_cache;
+
+            if (!source && !m_free_bufs.empty()) {
+                ret.data = std::move(m_free_bufs.back());
+                m_free_bufs.pop_back();
+            }
+        }
+
+        const uint8_t* src = nullptr;
+        if (source)
+        {
+            src = source->GetPage(ret.idx);
+            ret.succ = src != nullptr;
+        }
+        else
+        {
+            ret.data.resize(m_page_bytes);
+            ret.succ = ram_cache && ram_cache->Lookup(ret.idx, ret.data.data());
+            if (!ret.succ)
+            {
+                ret.succ = ReadPage(fin, ret.idx, ret.data.data());
+                if (ret.succ && ram_cache) {
+                    ram_cache->Insert(ret.idx, ret.data.data());
+                }
+            }
+            src = ret.data.data();
+        }
+
+        if (ret.succ && transcoder)
+        {
+            transcoder(src, trans_buf);
+            ret.data.swap(trans_buf);
+            ret.transcoded = true;
+        }
+        else if (ret.succ && source)
+        {
+            // keep the mapping alive until the result is polled
+            ret.mapped = src;
+            ret.source = source;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (ret.prefetch) {
+            --m_prefetch_running;
+        } else {
+            --m_visible_running;
+        }
+        m_completed.push_back(std::move(ret));
+        m_done_cond.notify_all();
+    }
+}
+
+void PageStreamer::PushRequest(const Request& req)
+{
+    // before the first finer page, behind the queued pages of its level
+    auto itr = std::find_if(m_requests.begin(), m_requests.end(), [&](const Request& r) {
+        return r.page.mip < req.page.mip;
+    });
+    m_requests.insert(itr, req);
+}
+
+bool PageStreamer::CanStartPrefetch() const
+{
+    // keep a worker free for visible pages
+    const size_t max_running = std::max(m_threads.size(), size_t(2)) - 1;
+    return !m_prefetch_requests.empty() && m_prefetch_running < max_running;
+}
+
+bool PageStreamer::ReadPage(std::ifstream& fin, int idx, uint8_t* dst) const
+{
+    if (!fin.is_open() || idx < 0 || idx >= static_cast<int>(m_offsets.size())) {
+        return false;
+    }
+
+    fin.clear();
+    fin.seekg(m_offsets[idx]);
+    fin.read(reinterpret_cast<char*>(dst), m_page_bytes);
+    return static_cast<size_t>(fin.gcount()) == m_page_bytes;
+}
+
+size_t PageStreamer::CalcPageCount(const textile::VTexInfo& info)
+{
+    size_t w = info.PageTableWidth();
+    size_t h = info.PageTableHeight();
+    const auto mip_count = static_cast<int>(std::log2(std::min(w, h))) + 1;
+
+    size_t count = 0;
+    for (int i = 0; i < mip_count; ++i)
+    {
+        count += w * h;
+        w = std::max(w / 2, size_t(1));
+        h = std::max(h / 2, size_t(1));
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,271 @@
+#include "clipmap/PixelConvert.h"
+
+// sse2 is part of x64, ssse3 and avx2 kernels are compiled for their
+// targets and picked by the cpu at runtime, no -m flags needed
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CLIPMAP_X86
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLIPMAP_SSE2
+#endif
+
+#ifdef CLIPMAP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CLIPMAP_TARGET(t)
+#else
+#define CLIPMAP_TARGET(t) __attribute__((target(t)))
+#endif
+#endif // CLIPMAP_X86
+
+namespace
+{
+
+#ifdef CLIPMAP_X86
+
+struct CpuFeatures
+{
+    CpuFeatures()
+    {
+#ifdef _MSC_VER
+        int r[4];
+        __cpuid(r, 0);
+        const int max_leaf = r[0];
+        __cpuid(r, 1);
+        ssse3 = (r[2] & (1 << 9)) != 0;
+        // avx state saved by the os
+        const bool avx = (r[2] & (1 << 28)) && (r[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+        if (avx && max_leaf >= 7)
+        {
+            __cpuidex(r, 7, 0);
+            avx2 = (r[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        ssse3 = __builtin_cpu_supports("ssse3");
+        avx2  = __builtin_cpu_supports("avx2");
+#endif // _MSC_VER
+    }
+
+    bool ssse3 = false;
+    bool avx2  = false;
+};
+
+const CpuFeatures& cpu()
+{
+    static const CpuFeatures features;
+    return features;
+}
+
+// the kernels return the number of elements done, the caller finishes the tail
+
+CLIPMAP_TARGET("ssse3")
+size_t rgb2rgba_ssse3(const uint8_t* src, uint8_t* dst, size_t pixel_count)
+{
+    // 16 pixels per loop, 48 bytes in and 64 bytes out
+    const __m128i mask  = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+    size_t i = 0;
+    for ( ; i + 16 <= pixel_count; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 16));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 32));
+
+        const __m128i p0 = _mm_shuffle_epi8(a, mask);
+        const __m128i p1 = _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), mask);
+        const __m128i p2 = _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), mask);
+        const __m128i p3 = _mm_shuffle_epi8(_mm_srli_si128(c, 4), mask);
+
+        __m128i* d = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(d,     _mm_or_si128(p0, alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(p1, alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(p2, alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(p3, alpha));
+    }
+    return i;
+}
+
+CLIPMAP_TARGET("avx2")
+size_t u16_to_u8_avx2(const uint16_t* src, uint8_t* dst, size_t count)
+{
+    size_t i = 0;
+    for ( ; i + 32 <= count; i += 32)
+    {
+        const __m256i a = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), 8);
+        const __m256i b = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16)), 8);
+        // packus works per 128-bit lane, restore the order
+        const __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), p);
+    }
+    return i;
+}
+
+CLIPMAP_TARGET("avx2")
+size_t is_uniform_avx2(const uint8_t* data, const uint8_t* shifted, size_t count, bool& uniform)
+{
+    size_t i = 0;
+    for ( ; i + 64 <= count; i += 64)
+    {
+        const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(shifted + i));
+        const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(shifted + i + 32));
+        const __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(a0, b0), _mm256_cmpeq_epi8(a1, b1));
+        if (_mm256_movemask_epi8(eq) != -1) {
+            uniform = false;
+            return i;
+        }
+    }
+    return i;
+}
+
+#endif // CLIPMAP_X86
+
+}
+
+namespace clipmap
+{
+
+void PixelConvert::RGB2RGBA(const uint8_t* src, uint8_t* dst, size_t pixel_count)
+{
+    size_t i = 0;
+
+#ifdef CLIPMAP_X86
+    if (cpu().ssse3) {
+        i = rgb2rgba_ssse3(src, dst, pixel_count);
+    }
+#endif // CLIPMAP_X86
+
+    for ( ; i < pixel_count; ++i)
+    {
+        dst[i * 4]     = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 0xff;
+    }
+}
+
+void PixelConvert::U16ToU8(const uint16_t* src, uint8_t* dst, size_t count)
+{
+    size_t i = 0;
+
+#ifdef CLIPMAP_X86
+    if (cpu().avx2) {
+        i = u16_to_u8_avx2(src, dst, count);
+    }
+#endif // CLIPMAP_X86
+#ifdef CLIPMAP_SSE2
+    for ( ; i + 16 <= count; i += 16)
+    {
+        const __m128i a = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), 8);
+        const __m128i b = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+    }
+#endif // CLIPMAP_SSE2
+
+    for ( ; i < count; ++i) {
+        dst[i] = static_cast<uint8_t>(src[i] >> 8);
+    }
+}
+
+void PixelConvert::Downsample2x2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst,
+                                 size_t dst_pixels, int channels)
+{
+    size_t i = 0;
+
+#if defined(CLIPMAP_SSE2)
+    // rgba, 4 pixels per loop, sums in 16 bits
+    if (channels == 4)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        for ( ; i + 4 <= dst_pixels; i += 4)
+        {
+            __m128i out[2];
+            for (int k = 0; k < 2; ++k)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + (i + k * 2) * 8));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + (i + k * 2) * 8));
+                // src pixels 0 1 and 2 3, rows added
+                const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                const __m128i sum = _mm_unpacklo_epi64(
+                    _mm_add_epi16(lo, _mm_srli_si128(lo, 8)),
+                    _mm_add_epi16(hi, _mm_srli_si128(hi, 8))
+                );
+                out[k] = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(out[0], out[1]));
+        }
+    }
+#endif // CLIPMAP_SSE2
+
+    for ( ; i < dst_pixels; ++i)
+    {
+        const uint8_t* a = row0 + i * 2 * channels;
+        const uint8_t* b = row1 + i * 2 * channels;
+        for (int c = 0; c < channels; ++c) {
+            dst[i * channels + c] = static_cast<uint8_t>((a[c] + a[c + channels] + b[c] + b[c + channels] + 2) >> 2);
+        }
+    }
+}
+
+void PixelConvert::Downsample2x2(const uint16_t* row0, const uint16_t* row1, uint16_t* dst,
+                                 size_t dst_pixels, int channels)
+{
+    for (size_t i = 0; i < dst_pixels; ++i)
+    {
+        const uint16_t* a = row0 + i * 2 * channels;
+        const uint16_t* b = row1 + i * 2 * channels;
+        for (int c = 0; c < channels; ++c) {
+            dst[i * channels + c] = static_cast<uint16_t>((a[c] + a[c + channels] + b[c] + b[c + channels] + 2) >> 2);
+        }
+    }
+}
+
+bool PixelConvert::IsUniform(const uint8_t* data, size_t size, size_t unit_bytes)
+{
+    if (size <= unit_bytes) {
+        return true;
+    }
+
+    // data equals itself shifted by one element
+    const uint8_t* shifted = data + unit_bytes;
+    const size_t count = size - unit_bytes;
+    size_t i = 0;
+
+#ifdef CLIPMAP_X86
+    if (cpu().avx2)
+    {
+        bool uniform = true;
+        i = is_uniform_avx2(data, shifted, count, uniform);
+        if (!uniform) {
+            return false;
+        }
+    }
+#endif // CLIPMAP_X86
+#ifdef CLIPMAP_SSE2
+    for ( ; i + 32 <= count; i += 32)
+    {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shifted + i));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shifted + i + 16));
+        const __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a0, b0), _mm_cmpeq_epi8(a1, b1));
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            return false;
+        }
+    }
+#endif // CLIPMAP_SSE2
+
+    for ( ; i < count; ++i) {
+        if (data[i] != shifted[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
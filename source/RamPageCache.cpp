@@ -0,0 +1,124 @@
+#include "clipmap/RamPageCache.h"
+#include "clipmap/PageCodec.h"
+
+#include <string.h>
+
+namespace clipmap
+{
+
+RamPageCache::RamPageCache(size_t page_bytes, size_t budget_bytes)
+    : m_page_bytes(page_bytes)
+    , m_budget(budget_bytes)
+{
+}
+
+bool RamPageCache::Lookup(int idx, uint8_t* dst)
+{
+    std::shared_ptr<const std::vector<uint8_t>> data;
+    bool raw = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto itr = m_map_page2entry.find(idx);
+        if (itr == m_map_page2entry.end()) {
+            ++m_stats.misses;
+            return false;
+        }
+
+        // touch
+        m_lru_list.splice(m_lru_list.begin(), m_lru_list, itr->second.lru_itr);
+        ++m_stats.hits;
+
+        // decompress outside the lock
+        data = itr->second.data;
+        raw  = itr->second.raw;
+    }
+
+    if (raw) {
+        memcpy(dst, data->data(), m_page_bytes);
+        return true;
+    }
+    return PageCodec::Decompress(data->data(), data->size(), dst, m_page_bytes);
+}
+
+void RamPageCache::Insert(int idx, const uint8_t* data)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_map_page2entry.find(idx) != m_map_page2entry.end()) {
+            return;
+        }
+    }
+
+    // compress outside the lock, workers insert in parallel
+    Entry entry;
+    auto buf = std::make_shared<std::vector<uint8_t>>(PageCodec::CalcBound(m_page_bytes));
+    const size_t sz = PageCodec::Compress(data, m_page_bytes, buf->data());
+    if (sz < m_page_bytes)
+    {
+        buf->resize(sz);
+    }
+    else
+    {
+        buf->assign(data, data + m_page_bytes);
+        entry.raw = true;
+    }
+    buf->shrink_to_fit();
+    entry.data = buf;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (buf->size() > m_budget) {
+        return;
+    }
+
+    auto ret = m_map_page2entry.insert({ idx, std::move(entry) });
+    if (!ret.second) {
+        return;
+    }
+
+    m_lru_list.push_front(idx);
+    ret.first->second.lru_itr = m_lru_list.begin();
+
+    ++m_stats.inserts;
+    m_stats.raw_bytes    += m_page_bytes;
+    m_stats.stored_bytes += buf->size();
+
+    EvictOverBudget();
+}
+
+void RamPageCache::SetBudget(size_t budget_bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budget_bytes;
+    EvictOverBudget();
+}
+
+RamPageCache::Stats RamPageCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void RamPageCache::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.hits      = 0;
+    m_stats.misses    = 0;
+    m_stats.inserts   = 0;
+    m_stats.evictions = 0;
+}
+
+void RamPageCache::EvictOverBudget()
+{
+    while (m_stats.stored_bytes > m_budget && !m_lru_list.empty())
+    {
+        auto itr = m_map_page2entry.find(m_lru_list.back());
+        m_stats.raw_bytes    -= m_page_bytes;
+        m_stats.stored_bytes -= itr->second.data->size();
+        ++m_stats.evictions;
+
+        m_map_page2entry.erase(itr);
+        m_lru_list.pop_back();
+    }
+}
+
+}
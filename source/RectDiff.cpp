@@ -0,0 +1,136 @@
+#include "clipmap/RectDiff.h"
+
+#include <textile/VTexInfo.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <assert.h>
+
+namespace
+{
+
+bool is_empty(const sm::rect& r)
+{
+    return !r.IsValid() || r.xmin >= r.xmax || r.ymin >= r.ymax;
+}
+
+}
+
+namespace clipmap
+{
+
+int RectDiff::Subtract(const sm::rect& a, const sm::rect& b, sm::rect out[4])
+{
+    if (is_empty(a)) {
+        return 0;
+    }
+    if (is_empty(b) || a.xmin >= b.xmax || a.xmax <= b.xmin || a.ymin >= b.ymax || a.ymax <= b.ymin) {
+        out[0] = a;
+        return 1;
+    }
+
+    // full width bands above and below b, then the sides of b
+    int num = 0;
+    if (a.ymin < b.ymin) {
+        out[num++] = sm::rect(a.xmin, a.ymin, a.xmax, b.ymin);
+    }
+    if (a.ymax > b.ymax) {
+        out[num++] = sm::rect(a.xmin, b.ymax, a.xmax, a.ymax);
+    }
+
+    const float ymin = std::max(a.ymin, b.ymin);
+    const float ymax = std::min(a.ymax, b.ymax);
+    if (a.xmin < b.xmin) {
+        out[num++] = sm::rect(a.xmin, ymin, b.xmin, ymax);
+    }
+    if (a.xmax > b.xmax) {
+        out[num++] = sm::rect(b.xmax, ymin, a.xmax, ymax);
+    }
+
+    return num;
+}
+
+void RectDiff::CalcDiffPages(const textile::VTexInfo& info, const sm::rect& old_r,
+                             const sm::rect& new_r, size_t layer, PageSet& pages)
+{
+    sm::rect parts[4];
+    const int part_n = Subtract(new_r, old_r, parts);
+    if (part_n == 0) {
+        return;
+    }
+
+    const float tile_sz = static_cast<float>(info.tile_size * std::pow(2, layer));
+
+    const size_t begin = pages.size();
+    for (int i = 0; i < part_n; ++i)
+    {
+        // coarser regions grow past the texture border, only pages inside are valid
+        sm::rect r = parts[i];
+        r.xmin = std::max(r.xmin, 0.0f);
+        r.ymin = std::max(r.ymin, 0.0f);
+        r.xmax = std::min(r.xmax, static_cast<float>(info.vtex_width));
+        r.ymax = std::min(r.ymax, static_cast<float>(info.vtex_height));
+        if (r.xmin >= r.xmax || r.ymin >= r.ymax) {
+            continue;
+        }
+
+        const int x_begin = static_cast<int>(std::floor(r.xmin / tile_sz));
+        const int x_end   = static_cast<int>(std::ceil(r.xmax / tile_sz)) - 1;
+        const int y_begin = static_cast<int>(std::floor(r.ymin / tile_sz));
+        const int y_end   = static_cast<int>(std::ceil(r.ymax / tile_sz)) - 1;
+        for (int y = y_begin; y <= y_end; ++y)
+        {
+            for (int x = x_begin; x <= x_end; ++x)
+            {
+                PageRegion p;
+                p.page = textile::Page(x, y, static_cast<int>(layer));
+                p.region.xmin = std::max(r.xmin, x * tile_sz);
+                p.region.xmax = std::min(r.xmax, x * tile_sz + tile_sz);
+                p.region.ymin = std::max(r.ymin, y * tile_sz);
+                p.region.ymax = std::min(r.ymax, y * tile_sz + tile_sz);
+                pages.push_back(p);
+            }
+        }
+    }
+
+    if (part_n == 1) {
+        return;
+    }
+
+    // pages at the corners of the parts show up twice, merge them. the
+    // merged region may cover texels which were valid, they are written
+    // again from the same page
+    std::sort(pages.begin() + begin, pages.end(), [](const PageRegion& a, const PageRegion& b) {
+        return a.page.y < b.page.y || (a.page.y == b.page.y && a.page.x < b.page.x);
+    });
+
+    size_t dst = begin;
+    for (size_t i = begin, n = pages.size(); i < n; ++i)
+    {
+        if (dst > begin && pages[dst - 1].page == pages[i].page)
+        {
+            auto& r = pages[dst - 1].region;
+            r.xmin = std::min(r.xmin, pages[i].region.xmin);
+            r.ymin = std::min(r.ymin, pages[i].region.ymin);
+            r.xmax = std::max(r.xmax, pages[i].region.xmax);
+            r.ymax = std::max(r.ymax, pages[i].region.ymax);
+        }
+        else
+        {
+            pages[dst++] = pages[i];
+        }
+    }
+    pages.resize(dst);
+}
+
+void RectDiff::CalcDiffPages(const textile::VTexInfo& info, const std::vector<sm::rect>& old_regions,
+                             const std::vector<sm::rect>& regions, size_t start_layer, PageSet& pages)
+{
+    assert(regions.size() == old_regions.size() - start_layer);
+    for (size_t i = start_layer, n = old_regions.size(); i < n; ++i) {
+        CalcDiffPages(info, old_regions[i], regions[i - start_layer], i, pages);
+    }
+}
+
+}
@@ -0,0 +1,91 @@
+#include "clipmap/Stats.h"
+
+#include <algorithm>
+
+#include <assert.h>
+
+namespace clipmap
+{
+
+size_t FrameStats::TotalStrips() const
+{
+    size_t ret = 0;
+    for (auto n : strips) {
+        ret += n;
+    }
+    return ret;
+}
+
+FrameStats& FrameStats::operator += (const FrameStats& stats)
+{
+    cache_hits      += stats.cache_hits;
+    cache_misses    += stats.cache_misses;
+    evictions       += stats.evictions;
+    pages_requested += stats.pages_requested;
+    pages_cancelled += stats.pages_cancelled;
+    pages_failed    += stats.pages_failed;
+    pages_uploaded  += stats.pages_uploaded;
+    pages_uniform   += stats.pages_uniform;
+    bytes_uploaded  += stats.bytes_uploaded;
+    bytes_source    += stats.bytes_source;
+    for (size_t i = 0; i < MAX_LAYERS; ++i) {
+        strips[i] += stats.strips[i];
+    }
+    draw_calls += stats.draw_calls;
+    load_ms    += stats.load_ms;
+    copy_ms    += stats.copy_ms;
+    draw_ms    += stats.draw_ms;
+    return *this;
+}
+
+StatsRecorder::StatsRecorder(size_t history_size)
+    : m_history(std::max(history_size, size_t(1)))
+{
+}
+
+void StatsRecorder::BeginFrame()
+{
+    if (!m_frame_open) {
+        m_frame_open = true;
+        return;
+    }
+
+    m_total += m_curr;
+
+    m_history[m_history_head] = m_curr;
+    m_history_head = (m_history_head + 1) % m_history.size();
+    ++m_frame_count;
+
+    m_curr = FrameStats();
+}
+
+const FrameStats& StatsRecorder::GetLastFrame() const
+{
+    const size_t n = m_history.size();
+    return m_history[(m_history_head + n - 1) % n];
+}
+
+size_t StatsRecorder::GetHistorySize() const
+{
+    return std::min(m_frame_count, m_history.size());
+}
+
+const FrameStats& StatsRecorder::GetHistory(size_t idx) const
+{
+    assert(idx < GetHistorySize());
+    const size_t n = m_history.size();
+    const size_t oldest = m_frame_count < n ? 0 : m_history_head;
+    return m_history[(oldest + idx) % n];
+}
+
+void StatsRecorder::Reset()
+{
+    m_curr  = FrameStats();
+    m_total = FrameStats();
+    std::fill(m_history.begin(), m_history.end(), FrameStats());
+    m_history_head = 0;
+    m_frame_count  = 0;
+    m_frame_open   = false;
+}
+
+}
@@ -1,10 +1,14 @@
 #include "clipmap/TextureStack.h"
 #include "clipmap/PageCache.h"
+#include "clipmap/Stats.h"
+#include "clipmap/RectDiff.h"
+#include "clipmap/UploadBudget.h"
 
 #include <SM_Calc.h>
 #include <tessellation/Painter.h>
 #include <unirender/Device.h>
 #include <unirender/TextureDescription.h>
+#include <unirender/Texture.h>
 #include <unirender/Framebuffer.h>
 #include <unirender/ShaderProgram.h>
 #include <unirender/RenderState.h>
@@ -12,42 +16,39 @@
 #include <unirender/Uniform.h>
 #include <unirender/DrawState.h>
 #include <unirender/Factory.h>
+#include <unirender/VertexArray.h>
 #include <shadertrans/ShaderTrans.h>
 #include <painting2/RenderSystem.h>
 #include <textile/VTexInfo.h>
 #include <textile/Page.h>
 
+#include <algorithm>
+
 #include <assert.h>
 
 namespace
 {
 
-const size_t TEX_SIZE = 512;
+// pos + texcoord + fill color
+const int UPDATE_VERT_STRIDE = sizeof(float) * 8;
 
 const char* update_vs = R"(
 
 #version 330 core
-layout (location = 0) in vec4 position;
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec2 texcoord;
+layout (location = 2) in vec4 color;
 
 out VS_OUT {
     vec2 texcoord;
+    vec4 color;
 } vs_out;
 
-uniform float u_page_scale;
-uniform vec2  u_page_pos;
-
-uniform vec2 u_update_size;
-uniform vec2 u_update_offset;
-
 void main()
 {
-    vec2 uv = position.xy;
-	vs_out.texcoord = uv * u_update_size + u_update_offset;
-
-    vec2 pos = uv * u_update_size + u_update_offset;
-    pos = pos * u_page_scale + u_page_pos;
-    pos = pos * 2 - 1;
-	gl_Position = vec4(pos, 0, 1);
+	vs_out.texcoord = texcoord;
+	vs_out.color = color;
+	gl_Position = vec4(position * 2 - 1, 0, 1);
 }
 
 )";
@@ -59,12 +60,18 @@ out vec4 FragColor;
 
 in VS_OUT {
     vec2 texcoord;
+    vec4 color;
 } fs_in;
 
 uniform sampler2D page_map;
 
 void main(void){
-    FragColor = texture2D(page_map, fs_in.texcoord);
+    // one colour pages have no pool slot
+    if (fs_in.texcoord.x < 0) {
+        FragColor = fs_in.color;
+    } else {
+        FragColor = texture2D(page_map, fs_in.texcoord);
+    }
 }
 
 )";
@@ -80,7 +87,7 @@ out VS_OUT {
 
 uniform mat4 u_view_mat;
 
-uniform float u_scale;
+uniform vec2 u_scale;
 uniform vec2 u_offset;
 
 void main()
@@ -103,11 +110,55 @@ in VS_OUT {
     vec2 texcoord;
 } fs_in;
 
-uniform sampler2D finer_tex;
-uniform sampler2D coarser_tex;
+uniform sampler2D layer_tex;
+uniform sampler2D residency_tex;
+
+uniform float u_tile_n;
+uniform float u_opaque;
+
+// mip tail level, xy offset and zw size in uv of the tail texture
+uniform float u_tail;
+uniform vec4  u_tail_rect;
+uniform vec2  u_tail_scale;
+uniform vec2  u_tail_border;
+
+// bilinear over the page slots, wrapped, 1 deep inside resident pages
+float residency(vec2 uv)
+{
+    int n = int(u_tile_n);
+    vec2 p = uv * u_tile_n - 0.5;
+    vec2 f = fract(p);
+    ivec2 i0 = (ivec2(floor(p)) % n + n) % n;
+    ivec2 i1 = (i0 + 1) % n;
+    float r00 = texelFetch(residency_tex, ivec2(i0.x, i0.y), 0).r;
+    float r10 = texelFetch(residency_tex, ivec2(i1.x, i0.y), 0).r;
+    float r01 = texelFetch(residency_tex, ivec2(i0.x, i1.y), 0).r;
+    float r11 = texelFetch(residency_tex, ivec2(i1.x, i1.y), 0).r;
+    return mix(mix(r00, r10, f.x), mix(r01, r11, f.x), f.y);
+}
 
 void main(void){
-    FragColor = texture2D(finer_tex, fs_in.texcoord);
+    // whole level in one place, clamp instead of wrap
+    if (u_tail > 0.5) {
+        vec2 t = clamp(fs_in.texcoord * u_tail_scale, u_tail_border, 1.0 - u_tail_border);
+        FragColor = texture2D(layer_tex, u_tail_rect.xy + t * u_tail_rect.zw);
+        return;
+    }
+
+    // layers are addressed toroidally, wrap into the ring
+    vec2 uv = fract(fs_in.texcoord);
+    vec4 color = texture2D(layer_tex, uv);
+    if (u_opaque > 0.5) {
+        FragColor = color;
+        return;
+    }
+
+    // fade to the coarser layer drawn before over half a page
+    float alpha = smoothstep(0.5, 1.0, residency(uv));
+    if (alpha <= 0.0) {
+        discard;
+    }
+    FragColor = vec4(color.rgb, alpha);
 }
 
 )";
@@ -117,36 +168,24 @@ void main(void){
 namespace clipmap
 {
 
-TextureStack::TextureStack(const textile::VTexInfo& info)
+TextureStack::TextureStack(const textile::VTexInfo& info, const Config& cfg)
     : m_vtex_info(info)
+    , m_cfg(cfg)
 {
-    auto mip_count = static_cast<int>(std::log2(std::min(info.PageTableWidth(), info.PageTableHeight()))) + 1;
-    m_layers.resize(mip_count);
+    m_level_num = static_cast<size_t>(std::log2(std::min(info.PageTableWidth(), info.PageTableHeight()))) + 1;
+    InitLevels();
 }
 
 void TextureStack::Init(const ur::Device& dev)
 {
-    if (m_layers[0].tex) {
+    if (m_update_shader) {
         return;
     }
 
-    // init textures
-    uint8_t* filling = new uint8_t[TEX_SIZE * TEX_SIZE * 4];
-    memset(filling, 0xaa, TEX_SIZE * TEX_SIZE * 4);
-
-    auto w = m_vtex_info.vtex_width;
-    auto h = m_vtex_info.vtex_height;
-    for (auto& layer : m_layers)
-    {
-        ur::TextureDescription desc;
-        desc.target = ur::TextureTarget::Texture2D;
-        desc.width = TEX_SIZE;
-        desc.height = TEX_SIZE;
-        desc.format = ur::TextureFormat::RGBA8;
-        layer.tex = dev.CreateTexture(desc, filling);
+    for (size_t i = m_min_level, n = m_layers.size(); i < n; ++i) {
+        AllocLayer(dev, i);
     }
-
-    delete[] filling;
+    AllocMipTail(dev);
 
     // init shader
     if (!m_update_shader)
@@ -158,80 +197,399 @@ void TextureStack::Init(const ur::Device& dev)
         shadertrans::ShaderTrans::GLSL2SpirV(shadertrans::ShaderStage::VertexShader, update_vs, vs);
         shadertrans::ShaderTrans::GLSL2SpirV(shadertrans::ShaderStage::PixelShader, update_fs, fs);
         m_update_shader = dev.CreateShaderProgram(vs, fs);
+
+        m_page_map_slot = m_update_shader->QueryTexSlot("page_map");
+    }
+
+    if (!m_fbo) {
+        m_fbo = dev.CreateFramebuffer();
+    }
+
+    // merged page quads of one layer
+    if (!m_update_va)
+    {
+        m_update_va = dev.CreateVertexArray();
+
+        std::vector<std::shared_ptr<ur::VertexInputAttribute>> vbuf_attrs(3);
+        vbuf_attrs[0] = std::make_shared<ur::VertexInputAttribute>(
+            0, ur::ComponentDataType::Float, 2, 0, UPDATE_VERT_STRIDE
+        );
+        vbuf_attrs[1] = std::make_shared<ur::VertexInputAttribute>(
+            1, ur::ComponentDataType::Float, 2, 8, UPDATE_VERT_STRIDE
+        );
+        vbuf_attrs[2] = std::make_shared<ur::VertexInputAttribute>(
+            2, ur::ComponentDataType::Float, 4, 16, UPDATE_VERT_STRIDE
+        );
+        m_update_va->SetVertexBufferAttrs(vbuf_attrs);
+    }
+}
+
+void TextureStack::SetConfig(const ur::Device& dev, const Config& cfg)
+{
+    assert(cfg.ring_size % m_vtex_info.tile_size == 0);
+    assert(cfg.viewport_width <= static_cast<int>(cfg.ring_size)
+        && cfg.viewport_height <= static_cast<int>(cfg.ring_size));
+
+    const auto old_cfg = m_cfg;
+    const auto old_min_level = m_min_level;
+    const auto old_layer_num = m_layers.size();
+    const bool ring_changed = cfg.ring_size != old_cfg.ring_size;
+
+    // the tail layout only depends on the ring size
+    auto old_tail = std::move(m_tail);
+    m_cfg = cfg;
+    InitLevels();
+    if (!ring_changed) {
+        m_tail = std::move(old_tail);
+    }
+
+    // layers which keep their texture, and with it their written pages
+    std::vector<bool> kept(m_layers.size(), false);
+    for (size_t i = m_min_level, n = m_layers.size(); i < n; ++i) {
+        kept[i] = !ring_changed && i >= old_min_level && i < old_layer_num
+            && cfg.GetFormat(i) == old_cfg.GetFormat(i);
+    }
+
+    // queued work of the other layers refers to the old layout, the kept
+    // layers still need theirs, their pages are marked resident or wanted
+    auto is_dropped = [&](const textile::Page& page) {
+        if (page.mip >= static_cast<int>(m_layers.size())) {
+            return ring_changed;
+        }
+        return !kept[page.mip];
+    };
+    m_page_draws.erase(std::remove_if(m_page_draws.begin(), m_page_draws.end(),
+        [&](const PageDraw& draw) { return is_dropped(draw.page); }), m_page_draws.end());
+    for (auto& page : m_pending) {
+        if (is_dropped(page)) {
+            m_pending_keys.erase(RectDiff::PageKey(page));
+        }
+    }
+    m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), is_dropped), m_pending.end());
+
+    // view is diffed again in the next Update()
+    m_scale = 0;
+
+    if (!m_update_shader) {
+        return;
+    }
+
+    for (size_t i = 0, n = m_layers.size(); i < n; ++i)
+    {
+        auto& layer = m_layers[i];
+        if (i < m_min_level)
+        {
+            layer = Layer();
+            continue;
+        }
+
+        if (!kept[i])
+        {
+            layer.region.MakeEmpty();
+            AllocLayer(dev, i);
+        }
+    }
+
+    if (ring_changed) {
+        AllocMipTail(dev);
     }
 }
 
 void TextureStack::Update(const ur::Device& dev, ur::Context& ctx,
                           PageCache& cache, const sm::rect& viewport,
-                          float scale, const sm::vec2& offset)
+                          float scale, const sm::vec2& offset, UploadBudget* budget)
 {
     // need init before
-    if (!m_layers[0].tex || !m_update_shader) {
+    if (!m_update_shader) {
         return;
     }
 
-    if (m_scale == scale && m_offset == offset) {
+    if (!m_tail.IsLoaded()) {
+        LoadMipTail(dev, cache);
+    }
+
+    if (IsViewChanged(viewport, scale, offset))
+    {
+        CalcViewDiff(viewport, scale, offset, m_view_diff);
+        ApplyViewDiff(cache, m_view_diff);
+    }
+
+    WritePendingPages(dev, cache, budget);
+
+    FlushPages(dev, ctx, cache);
+}
+
+void TextureStack::Update(const ur::Device& dev, ur::Context& ctx,
+                          PageCache& cache, const std::vector<sm::rect>& regions,
+                          size_t mipmap_level, UploadBudget* budget)
+{
+    // need init before
+    if (!m_update_shader) {
         return;
     }
 
-    m_scale = std::min(std::min(m_vtex_info.vtex_width / viewport.Width(), m_vtex_info.vtex_height / viewport.Height()), scale);
-    m_offset.x = std::max(0.0f, std::min(offset.x, m_vtex_info.vtex_width - viewport.Width() * scale));
-    m_offset.y = std::max(0.0f, std::min(offset.y, m_vtex_info.vtex_height - viewport.Height() * scale));
+    if (!m_tail.IsLoaded()) {
+        LoadMipTail(dev, cache);
+    }
 
-    sm::rect region = viewport;
-    region.Scale(sm::vec2(m_scale, m_scale));
-    region.Translate(m_offset);
+    if (IsViewChanged(regions, mipmap_level))
+    {
+        CalcViewDiff(regions, mipmap_level, m_view_diff);
+        ApplyViewDiff(cache, m_view_diff);
+    }
 
-    const int mipmap_level = CalcMipmapLevel(m_layers.size(), m_scale);
+    WritePendingPages(dev, cache, budget);
 
-    std::vector<sm::rect> regions;
-    regions.reserve(m_layers.size() - mipmap_level);
-    auto next_r = region;
+    FlushPages(dev, ctx, cache);
+}
+
+bool TextureStack::IsViewChanged(const sm::rect& viewport, float scale, const sm::vec2& offset) const
+{
+    const bool resized = viewport.Width() != m_viewport.Width()
+        || viewport.Height() != m_viewport.Height();
+    return m_scale != scale || m_offset != offset || resized;
+}
+
+void TextureStack::CalcViewDiff(const sm::rect& viewport, float scale, const sm::vec2& offset,
+                                ViewDiff& diff) const
+{
+    diff.viewport = viewport;
+    diff.scale    = scale;
+    diff.offset   = offset;
+    diff.mipmap_level = CalcRegions(m_vtex_info, m_layers.size(), viewport,
+        diff.scale, diff.offset, diff.regions, m_min_level);
+
+    diff.pages.clear();
+    RectDiff::CalcDiffPages(m_vtex_info, GetLayerRegions(), diff.regions, diff.mipmap_level, diff.pages);
+}
+
+bool TextureStack::IsViewChanged(const std::vector<sm::rect>& regions, size_t mipmap_level) const
+{
+    assert(regions.size() == m_layers.size());
+    mipmap_level = std::max(mipmap_level, m_min_level);
+    if (m_scale != std::pow(2.0f, static_cast<float>(mipmap_level))) {
+        return true;
+    }
     for (size_t i = mipmap_level, n = m_layers.size(); i < n; ++i)
     {
-        regions.push_back(next_r);
+        auto& a = m_layers[i].region;
+        auto& b = regions[i];
+        if (a.xmin != b.xmin || a.ymin != b.ymin || a.xmax != b.xmax || a.ymax != b.ymax) {
+            return true;
+        }
+    }
+    return false;
+}
 
-        auto c = next_r.Center();
-        auto sz = next_r.Size();
-        next_r.Scale(sm::vec2(2, 2));
-        next_r.Translate(next_r.Center() - c);
+void TextureStack::CalcViewDiff(const std::vector<sm::rect>& regions, size_t mipmap_level,
+                                ViewDiff& diff) const
+{
+    assert(regions.size() == m_layers.size() && mipmap_level < regions.size());
+    mipmap_level = std::max(mipmap_level, m_min_level);
+
+    // the finest region as an ortho view, for Draw() and Prefetch()
+    auto& finest = regions[mipmap_level];
+    diff.scale = std::pow(2.0f, static_cast<float>(mipmap_level));
+    if (finest.IsValid())
+    {
+        diff.offset = sm::vec2(finest.xmin, finest.ymin);
+        diff.viewport = sm::rect(0, 0, finest.Width() / diff.scale, finest.Height() / diff.scale);
+    }
+    else
+    {
+        diff.offset = sm::vec2(0, 0);
+        diff.viewport = sm::rect(0, 0, 0, 0);
     }
 
-    // load pages
-    TraverseDiffPages(regions, mipmap_level, [&](const textile::Page& page, const sm::rect& r) {
-        cache.Request(dev, page);
-    });
+    diff.mipmap_level = mipmap_level;
+    diff.regions.assign(regions.begin() + mipmap_level, regions.end());
 
-    // update levels
-    TraverseDiffPages(regions, mipmap_level, [&](const textile::Page& page, const sm::rect& r) {
-        auto tex = cache.QueryPageTex(page);
-        assert(tex);
-        AddPage(dev, ctx, page, tex, r);
-    });
+    diff.pages.clear();
+    RectDiff::CalcDiffPages(m_vtex_info, GetLayerRegions(), diff.regions, diff.mipmap_level, diff.pages);
+}
+
+void TextureStack::ApplyViewDiff(PageCache& cache, const ViewDiff& diff)
+{
+    m_viewport = diff.viewport;
+    m_scale    = diff.scale;
+    m_offset   = diff.offset;
+
+    // slots change pages, coarser layers show through until they are written
+    auto stats = CurrStats();
+    for (auto& p : diff.pages) {
+        CLIPMAP_STAT_ADD(stats, strips[std::min<size_t>(p.page.mip, FrameStats::MAX_LAYERS - 1)], 1);
+        SetPageResident(p.page, false);
+    }
+
+    // regions move right away, the pages follow within the budget
+    assert(diff.regions.size() == m_layers.size() - diff.mipmap_level);
+    for (size_t i = diff.mipmap_level, n = m_layers.size(); i < n; ++i)
+    {
+        auto& layer = m_layers[i];
+        layer.region = diff.regions[i - diff.mipmap_level];
+
+        // pages left behind, their slots are being taken over
+        for (auto itr = layer.resident.begin(); itr != layer.resident.end(); ) {
+            if (IsPageInRegion(RectDiff::KeyToPage(*itr))) {
+                ++itr;
+            } else {
+                itr = layer.resident.erase(itr);
+            }
+        }
+        layer.residency_dirty = true;
+    }
+
+    QueuePages(diff.pages);
 
-    assert(regions.size() == m_layers.size() - mipmap_level);
-    for (size_t i = mipmap_level, n = m_layers.size(); i < n; ++i) {
-        m_layers[i].region = regions[i - mipmap_level];
+    UpdatePageRefs(cache);
+}
+
+void TextureStack::Prefetch(PageCache& cache, const sm::rect& viewport,
+                            float scale, const sm::vec2& offset) const
+{
+    if (!m_update_shader) {
+        return;
     }
+
+    std::vector<sm::rect> regions;
+    auto pred_scale = scale;
+    auto pred_offset = offset;
+    const size_t mipmap_level = CalcRegions(m_vtex_info, m_layers.size(), viewport,
+        pred_scale, pred_offset, regions, m_min_level);
+
+    // only what the predicted view adds to the current regions
+    RectDiff::TraverseDiffPages(m_vtex_info, GetLayerRegions(), regions, mipmap_level,
+        [&](const textile::Page& page, const sm::rect&) {
+        cache.Prefetch(page);
+    });
 }
 
 void TextureStack::Draw(const ur::Device& dev, ur::Context& ctx,
                         float screen_width, float screen_height) const
 {
     assert(!m_layers.empty());
-    if (!m_layers[0].tex) {
+    if (!m_update_shader) {
         return;
     }
 
     auto rs = ur::DefaultRenderState2D();
-    DrawTexture(dev, ctx, rs, screen_width, screen_height);
+    {
+        CLIPMAP_STAT_TIMER(CurrStats(), draw_ms);
+        DrawTexture(dev, ctx, rs, screen_width, screen_height);
+    }
     DrawDebug(dev, ctx, rs);
 }
 
+void TextureStack::AddLoadedPage(const textile::Page& page, const PageCache::PageSlot& slot)
+{
+    // skip if the layer has moved away from the page, or the same page is
+    // already written, by key, not by its ring slot
+    if (!IsPageInRegion(page) || IsPageResident(page)) {
+        return;
+    }
+
+    auto& layer_r = m_layers[page.mip].region;
+
+    const float tile_sz = static_cast<float>(m_vtex_info.tile_size * std::pow(2, page.mip));
+    sm::rect r;
+    r.xmin = std::max(layer_r.xmin, page.x * tile_sz);
+    r.xmax = std::min(layer_r.xmax, page.x * tile_sz + tile_sz);
+    r.ymin = std::max(layer_r.ymin, page.y * tile_sz);
+    r.ymax = std::min(layer_r.ymax, page.y * tile_sz + tile_sz);
+    AddPage(page, slot, r);
+}
+
+void TextureStack::FlushPages(const ur::Device& dev, ur::Context& ctx, const PageCache& cache)
+{
+    // a page queued earlier in the frame may have lost its pool slot to a
+    // later one, draw it from where it is now, or queue it again
+    for (auto itr = m_page_draws.begin(); itr != m_page_draws.end(); )
+    {
+        auto slot = cache.QueryPageTex(itr->page);
+        if (slot.IsValid())
+        {
+            itr->slot = slot;
+            ++itr;
+            continue;
+        }
+
+        const auto page = itr->page;
+        itr = m_page_draws.erase(itr);
+        if (page.mip >= static_cast<int>(m_tail.first_level))
+        {
+            m_tail.written.erase(RectDiff::PageKey(page));
+        }
+        else
+        {
+            SetPageResident(page, false);
+            if (IsPageInRegion(page) && m_pending_keys.insert(RectDiff::PageKey(page)).second) {
+                m_pending.push_back(page);
+            }
+        }
+    }
+
+    UploadResidency();
+
+    if (m_page_draws.empty() || !m_update_shader) {
+        return;
+    }
+
+    auto stats = CurrStats();
+    CLIPMAP_STAT_TIMER(stats, copy_ms);
+
+    std::sort(m_page_draws.begin(), m_page_draws.end(), [](const PageDraw& a, const PageDraw& b) {
+        return a.page.mip < b.page.mip;
+    });
+
+    ctx.SetFramebuffer(m_fbo);
+    ctx.SetTexture(m_page_map_slot, cache.GetPoolTex());
+
+    // one draw per layer, one for the whole tail
+    const int tail_level = static_cast<int>(m_tail.first_level);
+    std::vector<float> verts;
+    for (size_t begin = 0, n = m_page_draws.size(); begin < n; )
+    {
+        const int layer = std::min(m_page_draws[begin].page.mip, tail_level);
+
+        verts.clear();
+        size_t end = begin;
+        for ( ; end < n && std::min(m_page_draws[end].page.mip, tail_level) == layer; ++end) {
+            BuildPageQuad(m_page_draws[end], verts);
+        }
+        begin = end;
+
+        const int vbuf_sz = static_cast<int>(verts.size() * sizeof(float));
+        if (!m_update_va->GetVertexBuffer() || vbuf_sz > m_update_vbuf_sz)
+        {
+            m_update_vbuf_sz = std::max(vbuf_sz, m_update_vbuf_sz * 2);
+            m_update_va->SetVertexBuffer(dev.CreateVertexBuffer(ur::BufferUsageHint::StreamDraw, m_update_vbuf_sz));
+        }
+        m_update_va->GetVertexBuffer()->ReadFromMemory(verts.data(), vbuf_sz, 0);
+
+        if (layer < tail_level) {
+            ctx.SetViewport(0, 0, m_cfg.ring_size, m_cfg.ring_size);
+        } else {
+            ctx.SetViewport(0, 0, m_tail.width, m_tail.height);
+        }
+        m_fbo->SetAttachment(ur::AttachmentType::Color0, ur::TextureTarget::Texture2D,
+            layer < tail_level ? m_layers[layer].tex : m_tail.tex, nullptr);
+
+        ur::DrawState ds;
+        ds.render_state = ur::DefaultRenderState2D();
+        ds.program = m_update_shader;
+        ds.vertex_array = m_update_va;
+        ctx.Draw(ur::PrimitiveType::Triangles, ds, nullptr);
+
+        CLIPMAP_STAT_ADD(stats, draw_calls, 1);
+    }
+
+    m_page_draws.clear();
+}
+
 void TextureStack::DebugDraw(const ur::Device& dev, ur::Context& ctx) const
 {
     assert(!m_layers.empty());
-    if (!m_layers[0].tex) {
+    if (!m_update_shader) {
         return;
     }
 
@@ -241,83 +599,522 @@ void TextureStack::DebugDraw(const ur::Device& dev, ur::Context& ctx) const
 
 size_t TextureStack::GetTextureSize() const
 {
-    return TEX_SIZE;
+    return m_cfg.ring_size;
 }
 
-sm::rect TextureStack::CalcUVRegion(int level, const Layer& layer)
+bool TextureStack::IsPageInRegion(const textile::Page& page) const
 {
-    const auto scale = static_cast<float>(1.0 / std::pow(2, level) / TEX_SIZE);
+    if (page.mip < 0 || page.mip >= static_cast<int>(m_layers.size())) {
+        return false;
+    }
+
+    auto& r = m_layers[page.mip].region;
+    if (!r.IsValid()) {
+        return false;
+    }
+
+    const float tile_sz = static_cast<float>(m_vtex_info.tile_size * std::pow(2, page.mip));
+    return page.x * tile_sz < r.xmax && (page.x + 1) * tile_sz > r.xmin
+        && page.y * tile_sz < r.ymax && (page.y + 1) * tile_sz > r.ymin;
+}
+
+sm::rect TextureStack::CalcUVRegion(int level, const Layer& layer, size_t ring_size)
+{
+    const auto scale = static_cast<float>(1.0 / std::pow(2, level) / ring_size);
     auto r = layer.region;
     r.Scale(sm::vec2(scale, scale));
+    if (r.IsValid()) {
+        // move origin into the ring, xmax/ymax may pass 1 and wrap around
+        r.Translate(sm::vec2(-std::floor(r.xmin), -std::floor(r.ymin)));
+    }
     return r;
 }
 
-size_t TextureStack::CalcMipmapLevel(int level_num, float scale)
+int TextureStack::WrapPageSlot(int page, int tile_n)
+{
+    const int slot = page % tile_n;
+    return slot < 0 ? slot + tile_n : slot;
+}
+
+size_t TextureStack::CalcMipmapLevel(int level_num, float scale, size_t min_level)
 {
     float level = log(scale) / log(2.0f);
     level = std::min(static_cast<float>(level_num - 1), std::max(0.0f, level));
-    return static_cast<size_t>(std::ceil(level));
+    return std::max(static_cast<size_t>(std::ceil(level)), min_level);
 }
 
-void TextureStack::AddPage(const ur::Device& dev, ur::Context& ctx, const textile::Page& page,
-                           const ur::TexturePtr& tex, const sm::rect& region)
+void TextureStack::InitLevels()
 {
-    if (!region.IsValid() || region.Width() == 0 || region.Height() == 0) {
+    m_tail = MipTail();
+    InitMipTail();
+    m_layers.resize(m_tail.first_level);
+
+    // keep the coarsest level_num ring layers
+    const size_t ring_num = m_tail.first_level;
+    const size_t keep = m_cfg.level_num == 0 ? ring_num : std::min(m_cfg.level_num, ring_num);
+    m_min_level = ring_num - keep;
+}
+
+void TextureStack::AllocLayer(const ur::Device& dev, size_t level)
+{
+    auto& layer = m_layers[level];
+
+    const size_t ring = m_cfg.ring_size;
+    const auto fmt = m_cfg.GetFormat(level);
+
+    ur::TextureDescription desc;
+    desc.target = ur::TextureTarget::Texture2D;
+    desc.width  = static_cast<int>(ring);
+    desc.height = static_cast<int>(ring);
+    desc.format = fmt;
+    if (fmt == ur::TextureFormat::RGBA8)
+    {
+        std::vector<uint8_t> filling(ring * ring * 4, 0xaa);
+        layer.tex = dev.CreateTexture(desc, filling.data());
+    }
+    else
+    {
+        layer.tex = dev.CreateTexture(desc, nullptr);
+    }
+
+    // nothing is resident yet
+    const int tile_n = static_cast<int>(ring / m_vtex_info.tile_size);
+    layer.resident.clear();
+    layer.residency.assign(tile_n * tile_n, 0);
+    layer.residency_dirty = false;
+
+    desc.width  = tile_n;
+    desc.height = tile_n;
+    desc.format = ur::TextureFormat::RED;
+    layer.residency_tex = dev.CreateTexture(desc, layer.residency.data());
+}
+
+void TextureStack::AllocMipTail(const ur::Device& dev)
+{
+    m_tail.tex = nullptr;
+    m_tail.written.clear();
+    if (m_tail.rects.empty()) {
         return;
     }
 
-    assert(page.mip < static_cast<int>(m_layers.size()));
+    std::vector<uint8_t> filling(m_tail.width * m_tail.height * 4, 0xaa);
+
+    ur::TextureDescription desc;
+    desc.target = ur::TextureTarget::Texture2D;
+    desc.width  = m_tail.width;
+    desc.height = m_tail.height;
+    desc.format = ur::TextureFormat::RGBA8;
+    m_tail.tex = dev.CreateTexture(desc, filling.data());
+}
+
+void TextureStack::InitMipTail()
+{
+    const size_t tile_sz = m_vtex_info.tile_size;
+    const size_t ptw = m_vtex_info.PageTableWidth();
+    const size_t pth = m_vtex_info.PageTableHeight();
+
+    // first level inside one layer, level 0 stays a ring
+    size_t first = 1;
+    while (first < m_level_num
+        && ((ptw >> first) * tile_sz > m_cfg.ring_size || (pth >> first) * tile_sz > m_cfg.ring_size)) {
+        ++first;
+    }
+    m_tail.first_level = first;
+    if (first >= m_level_num) {
+        return;
+    }
+
+    // first level on the left, the rest stacked in a column on its right
+    const float w0 = static_cast<float>((ptw >> first) * tile_sz);
+    const float h0 = static_cast<float>((pth >> first) * tile_sz);
+    float x = 0, y = 0, w = w0;
+    for (size_t i = first; i < m_level_num; ++i)
+    {
+        const size_t pw = std::max(ptw >> i, size_t(1));
+        const size_t ph = std::max(pth >> i, size_t(1));
+        const float lw = static_cast<float>(pw * tile_sz);
+        const float lh = static_cast<float>(ph * tile_sz);
+        m_tail.rects.push_back(sm::rect(x, y, x + lw, y + lh));
+        m_tail.page_count += pw * ph;
+
+        if (i == first) {
+            x = w0;
+        } else {
+            y += lh;
+            w = std::max(w, x + lw);
+        }
+    }
+    m_tail.width  = static_cast<int>(w);
+    m_tail.height = static_cast<int>(h0);
+}
+
+void TextureStack::LoadMipTail(const ur::Device& dev, PageCache& cache)
+{
+    if (!m_tail.tex) {
+        return;
+    }
+
+    const float tile_sz = static_cast<float>(m_vtex_info.tile_size);
+    for (size_t i = m_tail.first_level; i < m_level_num; ++i)
+    {
+        auto& r = m_tail.rects[i - m_tail.first_level];
+        const int pw = static_cast<int>(r.Width() / tile_sz);
+        const int ph = static_cast<int>(r.Height() / tile_sz);
+        for (int y = 0; y < ph; ++y)
+        {
+            for (int x = 0; x < pw; ++x)
+            {
+                const textile::Page page(x, y, static_cast<int>(i));
+                const auto key = RectDiff::PageKey(page);
+                if (m_tail.written.find(key) != m_tail.written.end()) {
+                    continue;
+                }
+
+                // streamed pages are picked up by a later call, the ref
+                // keeps the queued load from being cancelled meanwhile
+                if (!cache.Fetch(dev, page)) {
+                    if (m_tail_refs.emplace(key, page).second) {
+                        cache.AddRef(page);
+                    }
+                    continue;
+                }
+
+                const float layer_tile_sz = tile_sz * static_cast<float>(std::pow(2, i));
+                PageDraw draw;
+                draw.page    = page;
+                draw.slot    = cache.QueryPageTex(page);
+                draw.region  = sm::rect(x * layer_tile_sz, y * layer_tile_sz,
+                    (x + 1) * layer_tile_sz, (y + 1) * layer_tile_sz);
+                m_page_draws.push_back(draw);
+
+                m_tail.written.insert(key);
+            }
+        }
+    }
+
+    if (m_tail.IsLoaded())
+    {
+        for (auto& itr : m_tail_refs) {
+            cache.Release(itr.second);
+        }
+        m_tail_refs.clear();
+    }
+}
+
+void TextureStack::ReleasePageRefs(PageCache& cache)
+{
+    for (auto& page : m_ref_pages) {
+        cache.Release(page);
+    }
+    m_ref_pages.clear();
+
+    for (auto& itr : m_tail_refs) {
+        cache.Release(itr.second);
+    }
+    m_tail_refs.clear();
+}
+
+void TextureStack::UpdatePageRefs(PageCache& cache)
+{
+    // every page of the regions, in key order
+    const std::vector<sm::rect> empty(m_layers.size());
+    RectDiff::PageSet pages;
+    RectDiff::CalcDiffPages(m_vtex_info, empty, GetLayerRegions(), 0, pages);
+
+    std::vector<textile::Page> ref_pages;
+    ref_pages.reserve(pages.size());
+    for (auto& p : pages) {
+        ref_pages.push_back(p.page);
+    }
+
+    // merge the old and new lists, ref what came in, release what left
+    size_t i = 0, j = 0;
+    while (i < m_ref_pages.size() || j < ref_pages.size())
+    {
+        const uint64_t old_key = i < m_ref_pages.size() ? RectDiff::PageKey(m_ref_pages[i]) : UINT64_MAX;
+        const uint64_t new_key = j < ref_pages.size() ? RectDiff::PageKey(ref_pages[j]) : UINT64_MAX;
+        if (old_key == new_key) {
+            ++i;
+            ++j;
+        } else if (old_key < new_key) {
+            cache.Release(m_ref_pages[i++]);
+        } else {
+            cache.AddRef(ref_pages[j++]);
+        }
+    }
+
+    m_ref_pages.swap(ref_pages);
+}
+
+void TextureStack::QueuePages(const RectDiff::PageSet& pages)
+{
+    // drop pages the layers have moved away from
+    auto end = std::remove_if(m_pending.begin(), m_pending.end(), [&](const textile::Page& page) {
+        return !IsPageInRegion(page);
+    });
+    for (auto itr = end; itr != m_pending.end(); ++itr) {
+        m_pending_keys.erase(RectDiff::PageKey(*itr));
+    }
+    m_pending.erase(end, m_pending.end());
+
+    for (auto& p : pages) {
+        if (m_pending_keys.insert(RectDiff::PageKey(p.page)).second) {
+            m_pending.push_back(p.page);
+        }
+    }
+
+    // coarse levels first, then by distance from the view center
+    const auto center = m_layers[CalcMipmapLevel(m_layers.size(), m_scale, m_min_level)].region.Center();
+    auto priority_less = [&](const textile::Page& a, const textile::Page& b)
+    {
+        if (a.mip != b.mip) {
+            return a.mip < b.mip;
+        }
+        const float tile_sz = static_cast<float>(m_vtex_info.tile_size * std::pow(2, a.mip));
+        const sm::vec2 da = sm::vec2((a.x + 0.5f) * tile_sz, (a.y + 0.5f) * tile_sz) - center;
+        const sm::vec2 db = sm::vec2((b.x + 0.5f) * tile_sz, (b.y + 0.5f) * tile_sz) - center;
+        return da.x * da.x + da.y * da.y > db.x * db.x + db.y * db.y;
+    };
+    std::sort(m_pending.begin(), m_pending.end(), priority_less);
+}
+
+void TextureStack::WritePendingPages(const ur::Device& dev, PageCache& cache, UploadBudget* budget)
+{
+    CLIPMAP_STAT_TIMER(CurrStats(), load_ms);
+
+    while (!(budget && budget->IsExhausted()) && WriteNextPendingPage(dev, cache, budget)) {
+        ;
+    }
+}
+
+bool TextureStack::WriteNextPendingPage(const ur::Device& dev, PageCache& cache, UploadBudget* budget)
+{
+    // misses stay queued while the loader is full, in their latest order,
+    // the pages behind them already in the pool are still written
+    const bool loads_full = cache.IsLoadQueueFull();
+
+    for (size_t i = m_pending.size(); i > 0; --i)
+    {
+        const auto page = m_pending[i - 1];
+
+        const bool resident = IsPageResident(page);
+        const bool hit = !resident && cache.QueryPageTex(page).IsValid();
+        if (!resident && !hit && loads_full) {
+            continue;
+        }
+
+        m_pending.erase(m_pending.begin() + (i - 1));
+        m_pending_keys.erase(RectDiff::PageKey(page));
+
+        // this very page arrived as a prefetched page meanwhile, a page
+        // sharing its ring slot doesn't count
+        if (resident) {
+            continue;
+        }
+
+        // pages still streaming are written by AddLoadedPage() when they arrive
+        if (!cache.Fetch(dev, page)) {
+            assert(cache.IsStreaming());
+            return true;
+        }
+
+        AddLoadedPage(page, cache.QueryPageTex(page));
+        if (budget) {
+            budget->Consume(hit ? 0 : cache.GetPageBytes());
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TextureStack::IsPageResident(const textile::Page& page) const
+{
+    if (page.mip < 0 || page.mip >= static_cast<int>(m_layers.size())) {
+        return false;
+    }
+
     auto& layer = m_layers[page.mip];
-    auto tile_sz = m_vtex_info.tile_size;
+    return layer.resident.find(RectDiff::PageKey(page)) != layer.resident.end();
+}
 
-    if (!m_fbo) {
-        dev.CreateFramebuffer();
+void TextureStack::SetPageResident(const textile::Page& page, bool resident)
+{
+    auto& layer = m_layers[page.mip];
+    if (layer.residency.empty()) {
+        return;
     }
 
-    ctx.SetViewport(0, 0, TEX_SIZE, TEX_SIZE);
+    const uint64_t key = RectDiff::PageKey(page);
+    const bool changed = resident ? layer.resident.insert(key).second : layer.resident.erase(key) > 0;
+    if (changed) {
+        layer.residency_dirty = true;
+    }
+}
 
-    ctx.SetFramebuffer(m_fbo);
-    m_fbo->SetAttachment(ur::AttachmentType::Color0, ur::TextureTarget::Texture2D, layer.tex, nullptr);
-
-    ctx.SetTexture(m_update_shader->QueryTexSlot("page_map"), tex);
-
-    auto u_page_scale = m_update_shader->QueryUniform("u_page_scale");
-    assert(u_page_scale);
-    float page_scale = static_cast<float>(m_vtex_info.tile_size) / TEX_SIZE;
-    u_page_scale->SetValue(&page_scale, 1);
-
-    const int tile_n = TEX_SIZE / tile_sz;
-    sm::vec2 offset(
-        static_cast<float>(page.x % tile_n) * tile_sz / TEX_SIZE,
-        static_cast<float>(page.y % tile_n) * tile_sz / TEX_SIZE
-    );
-    offset.x += tile_sz / TEX_SIZE;
-    offset.y += tile_sz / TEX_SIZE;
-    auto u_page_pos = m_update_shader->QueryUniform("u_page_pos");
-    assert(u_page_pos);
-    u_page_pos->SetValue(offset.xy, 2);
+void TextureStack::UploadResidency()
+{
+    const int tile_n = static_cast<int>(m_cfg.ring_size / m_vtex_info.tile_size);
+    for (size_t i = 0, n = m_layers.size(); i < n; ++i)
+    {
+        auto& layer = m_layers[i];
+        if (layer.residency_dirty && layer.residency_tex)
+        {
+            // a slot is resident if all region pages on it are
+            std::fill(layer.residency.begin(), layer.residency.end(), 0xff);
+            const float tile_sz = static_cast<float>(m_vtex_info.tile_size * std::pow(2, i));
+            auto& r = layer.region;
+            if (r.IsValid())
+            {
+                const int x0 = static_cast<int>(std::floor(r.xmin / tile_sz));
+                const int y0 = static_cast<int>(std::floor(r.ymin / tile_sz));
+                const int x1 = static_cast<int>(std::ceil(r.xmax / tile_sz));
+                const int y1 = static_cast<int>(std::ceil(r.ymax / tile_sz));
+                for (int y = y0; y < y1; ++y) {
+                    for (int x = x0; x < x1; ++x) {
+                        const textile::Page page(x, y, static_cast<int>(i));
+                        if (IsPageInRegion(page) && !IsPageResident(page)) {
+                            layer.residency[WrapPageSlot(y, tile_n) * tile_n + WrapPageSlot(x, tile_n)] = 0;
+                        }
+                    }
+                }
+            }
+            layer.residency_tex->Upload(layer.residency.data(), 0, 0, tile_n, tile_n, 0, 1);
+        }
+        layer.residency_dirty = false;
+    }
+}
+
+size_t TextureStack::CalcFallbackLayer(size_t start_layer) const
+{
+    // the tail is always complete
+    if (start_layer >= m_layers.size()) {
+        return start_layer;
+    }
+
+    // finest region is the view
+    const auto& view = m_layers[start_layer].region;
+    if (!view.IsValid()) {
+        return start_layer;
+    }
+
+    for (size_t i = start_layer, n = m_layers.size(); i < n; ++i)
+    {
+        const float tile_sz = static_cast<float>(m_vtex_info.tile_size * std::pow(2, i));
+        const int x_begin = static_cast<int>(std::floor(std::max(view.xmin, 0.0f) / tile_sz));
+        const int y_begin = static_cast<int>(std::floor(std::max(view.ymin, 0.0f) / tile_sz));
+        const int x_end = static_cast<int>(std::ceil(std::min(view.xmax, static_cast<float>(m_vtex_info.vtex_width)) / tile_sz)) - 1;
+        const int y_end = static_cast<int>(std::ceil(std::min(view.ymax, static_cast<float>(m_vtex_info.vtex_height)) / tile_sz)) - 1;
+
+        bool all_resident = true;
+        for (int y = y_begin; y <= y_end && all_resident; ++y) {
+            for (int x = x_begin; x <= x_end && all_resident; ++x) {
+                all_resident = IsPageResident(textile::Page(x, y, static_cast<int>(i)));
+            }
+        }
+        if (all_resident) {
+            return i;
+        }
+    }
+
+    return m_tail.tex ? m_layers.size() : m_layers.size() - 1;
+}
+
+FrameStats* TextureStack::CurrStats() const
+{
+    return m_stats ? m_stats->GetCurrFrame() : nullptr;
+}
+
+std::vector<sm::rect> TextureStack::GetLayerRegions() const
+{
+    std::vector<sm::rect> regions;
+    regions.reserve(m_layers.size());
+    for (auto& layer : m_layers) {
+        regions.push_back(layer.region);
+    }
+    return regions;
+}
+
+void TextureStack::AddPage(const textile::Page& page, const PageCache::PageSlot& slot,
+                           const sm::rect& region)
+{
+    if (!region.IsValid() || region.Width() == 0 || region.Height() == 0) {
+        return;
+    }
+
+    assert(page.mip < static_cast<int>(m_layers.size()));
+
+    PageDraw draw;
+    draw.page    = page;
+    draw.slot    = slot;
+    draw.region  = region;
+    m_page_draws.push_back(draw);
+
+    // drawn by FlushPages() before this frame's Draw()
+    SetPageResident(page, true);
+}
+
+void TextureStack::BuildPageQuad(const PageDraw& draw, std::vector<float>& verts) const
+{
+    auto& page = draw.page;
+    auto& region = draw.region;
+    auto tile_sz = m_vtex_info.tile_size;
 
     const float layer_tile_sz = static_cast<float>(tile_sz * std::pow(2.0f, page.mip));
 
-    const sm::vec2 update_size(region.Width(), region.Height());
-    auto u_update_size = m_update_shader->QueryUniform("u_update_size");
-    assert(u_update_size);
-    auto tile_update_size = update_size / layer_tile_sz;
-    u_update_size->SetValue(tile_update_size.xy, 2);
+    // updated part of the page, in [0, 1]
+    const float px0 = (region.xmin - page.x * layer_tile_sz) / layer_tile_sz;
+    const float py0 = (region.ymin - page.y * layer_tile_sz) / layer_tile_sz;
+    const float px1 = (region.xmax - page.x * layer_tile_sz) / layer_tile_sz;
+    const float py1 = (region.ymax - page.y * layer_tile_sz) / layer_tile_sz;
 
-    sm::vec2 update_offset;
-    update_offset.x = region.xmin - static_cast<int>(region.xmin / layer_tile_sz) * layer_tile_sz;
-    update_offset.y = region.ymin - static_cast<int>(region.ymin / layer_tile_sz) * layer_tile_sz;
-    auto u_update_offset = m_update_shader->QueryUniform("u_update_offset");
-    assert(u_update_offset);
-    auto tile_update_offset = update_offset / layer_tile_sz;
-    u_update_offset->SetValue(tile_update_offset.xy, 2);
+    // dst in layer, or at the level's place in the tail
+    float ox, oy, sx, sy;
+    if (page.mip < static_cast<int>(m_tail.first_level))
+    {
+        const int tile_n = static_cast<int>(m_cfg.ring_size / tile_sz);
+        sx = sy = static_cast<float>(tile_sz) / m_cfg.ring_size;
+        ox = WrapPageSlot(page.x, tile_n) * sx;
+        oy = WrapPageSlot(page.y, tile_n) * sy;
+    }
+    else
+    {
+        auto& r = m_tail.rects[page.mip - m_tail.first_level];
+        sx = static_cast<float>(tile_sz) / m_tail.width;
+        sy = static_cast<float>(tile_sz) / m_tail.height;
+        ox = r.xmin / m_tail.width + page.x * sx;
+        oy = r.ymin / m_tail.height + page.y * sy;
+    }
+    const float x0 = ox + px0 * sx, x1 = ox + px1 * sx;
+    const float y0 = oy + py0 * sy, y1 = oy + py1 * sy;
 
-    ur::DrawState ds;
-    ds.render_state = ur::DefaultRenderState2D();
-    ds.program = m_update_shader;
-    ds.vertex_array = dev.GetVertexArray(ur::Device::PrimitiveType::Quad, ur::VertexLayoutType::Pos);
-    ctx.Draw(ur::PrimitiveType::TriangleStrip, ds, nullptr);
+    // src in pool, or the fill colour with a negative texcoord
+    float u0 = -1, u1 = -1, v0 = -1, v1 = -1;
+    float color[4] = { 0, 0, 0, 0 };
+    if (draw.slot.uniform)
+    {
+        for (int i = 0; i < 4; ++i) {
+            color[i] = ((draw.slot.color >> (i * 8)) & 0xff) / 255.0f;
+        }
+    }
+    else
+    {
+        auto& uv = draw.slot.uv;
+        u0 = uv.xmin + px0 * uv.Width();
+        u1 = uv.xmin + px1 * uv.Width();
+        v0 = uv.ymin + py0 * uv.Height();
+        v1 = uv.ymin + py1 * uv.Height();
+    }
+    const float r = color[0], g = color[1], b = color[2], a = color[3];
+
+    const float quad[] = {
+        x0, y0, u0, v0, r, g, b, a,
+        x1, y0, u1, v0, r, g, b, a,
+        x1, y1, u1, v1, r, g, b, a,
+        x0, y0, u0, v0, r, g, b, a,
+        x1, y1, u1, v1, r, g, b, a,
+        x0, y1, u0, v1, r, g, b, a,
+    };
+    verts.insert(verts.end(), std::begin(quad), std::end(quad));
 }
 
 void TextureStack::DrawTexture(const ur::Device& dev, ur::Context& ctx, const ur::RenderState& rs,
@@ -325,41 +1122,89 @@ void TextureStack::DrawTexture(const ur::Device& dev, ur::Context& ctx, const ur
 {
     if (!m_final_shader)
     {
-        //std::vector<std::string> textures;
-        //textures.push_back("finer_tex");
-        //textures.push_back("coarser_tex");
-
         std::vector<unsigned int> vs, fs;
         shadertrans::ShaderTrans::GLSL2SpirV(shadertrans::ShaderStage::VertexShader, final_vs, vs);
         shadertrans::ShaderTrans::GLSL2SpirV(shadertrans::ShaderStage::PixelShader, final_fs, fs);
         m_final_shader = dev.CreateShaderProgram(vs, fs);
     }
 
-    const uint32_t finer_layer = CalcMipmapLevel(m_layers.size(), m_scale);
-    const uint32_t coarser_layer = finer_layer < m_layers.size() - 1 ? finer_layer + 1 : finer_layer;
-    ctx.SetTexture(m_final_shader->QueryTexSlot("finer_tex"), m_layers[finer_layer].tex);
-    ctx.SetTexture(m_final_shader->QueryTexSlot("coarser_tex"), m_layers[coarser_layer].tex);
-
-    sm::mat4 view_mat = sm::mat4::Scaled(TEX_SIZE / screen_width, TEX_SIZE / screen_height, 1);
+    const float ring = static_cast<float>(m_cfg.ring_size);
+    sm::mat4 view_mat = sm::mat4::Scaled(m_viewport.Width() / screen_width, m_viewport.Height() / screen_height, 1);
     auto u_view_mat = m_final_shader->QueryUniform("u_view_mat");
     assert(u_view_mat);
     u_view_mat->SetValue(view_mat.x, 4 * 4);
 
-    auto scale = m_scale / static_cast<float>(std::pow(2, finer_layer));
-    auto u_scale = m_final_shader->QueryUniform("u_scale");
-    assert(u_scale);
-    u_scale->SetValue(&scale, 1);
+    auto u_tile_n = m_final_shader->QueryUniform("u_tile_n");
+    assert(u_tile_n);
+    const float tile_n = static_cast<float>(m_cfg.ring_size / m_vtex_info.tile_size);
+    u_tile_n->SetValue(&tile_n, 1);
 
-    auto offset = m_offset / TEX_SIZE / static_cast<float>(std::pow(2, finer_layer));
-    auto u_offset = m_final_shader->QueryUniform("u_offset");
-    assert(u_offset);
-    u_offset->SetValue(offset.xy, 2);
+    auto u_scale   = m_final_shader->QueryUniform("u_scale");
+    auto u_offset  = m_final_shader->QueryUniform("u_offset");
+    auto u_opaque  = m_final_shader->QueryUniform("u_opaque");
+    auto u_tail    = m_final_shader->QueryUniform("u_tail");
+    assert(u_scale && u_offset && u_opaque && u_tail);
+
+    const int layer_slot     = m_final_shader->QueryTexSlot("layer_tex");
+    const int residency_slot = m_final_shader->QueryTexSlot("residency_tex");
+
+    // coarse to fine, start from the finest layer which covers the whole
+    // view, finer layers only draw where their pages are resident
+    const size_t finer_layer = CalcMipmapLevel(m_level_num, m_scale, m_min_level);
+    const size_t start_layer = CalcFallbackLayer(finer_layer);
 
     ur::DrawState ds;
-    ds.render_state = rs;
     ds.program = m_final_shader;
     ds.vertex_array = dev.GetVertexArray(ur::Device::PrimitiveType::Quad, ur::VertexLayoutType::Pos);
-    ctx.Draw(ur::PrimitiveType::TriangleStrip, ds, nullptr);
+    for (int i = static_cast<int>(start_layer); i >= static_cast<int>(finer_layer); --i)
+    {
+        const bool tail = i >= static_cast<int>(m_tail.first_level);
+        if (tail)
+        {
+            ctx.SetTexture(layer_slot, m_tail.tex);
+            ctx.SetTexture(residency_slot, m_layers[m_min_level].residency_tex);
+
+            auto& r = m_tail.rects[i - m_tail.first_level];
+            const float w = static_cast<float>(m_tail.width);
+            const float h = static_cast<float>(m_tail.height);
+            const float rect[4] = { r.xmin / w, r.ymin / h, r.Width() / w, r.Height() / h };
+            m_final_shader->QueryUniform("u_tail_rect")->SetValue(rect, 4);
+            const float tail_scale[2] = { ring / r.Width(), ring / r.Height() };
+            m_final_shader->QueryUniform("u_tail_scale")->SetValue(tail_scale, 2);
+            const float border[2] = { 0.5f / r.Width(), 0.5f / r.Height() };
+            m_final_shader->QueryUniform("u_tail_border")->SetValue(border, 2);
+        }
+        else
+        {
+            auto& layer = m_layers[i];
+            ctx.SetTexture(layer_slot, layer.tex);
+            ctx.SetTexture(residency_slot, layer.residency_tex);
+        }
+        const float tail_f = tail ? 1.0f : 0.0f;
+        u_tail->SetValue(&tail_f, 1);
+
+        // view size in ring uv of this layer
+        const float level_scale = m_scale / static_cast<float>(std::pow(2, i)) / ring;
+        const float scale[2] = { m_viewport.Width() * level_scale, m_viewport.Height() * level_scale };
+        u_scale->SetValue(scale, 2);
+
+        auto offset = m_offset / ring / static_cast<float>(std::pow(2, i));
+        u_offset->SetValue(offset.xy, 2);
+
+        const bool opaque = i == static_cast<int>(start_layer);
+        const float opaque_f = opaque ? 1.0f : 0.0f;
+        u_opaque->SetValue(&opaque_f, 1);
+
+        ds.render_state = rs;
+        if (!opaque) {
+            ds.render_state.blending.enabled = true;
+            ds.render_state.blending.src = ur::BlendingFactor::SourceAlpha;
+            ds.render_state.blending.dst = ur::BlendingFactor::OneMinusSourceAlpha;
+        }
+        ctx.Draw(ur::PrimitiveType::TriangleStrip, ds, nullptr);
+
+        CLIPMAP_STAT_ADD(CurrStats(), draw_calls, 1);
+    }
 }
 
 void TextureStack::DrawDebug(const ur::Device& dev, ur::Context& ctx, const ur::RenderState& rs) const
@@ -367,18 +1212,22 @@ void TextureStack::DrawDebug(const ur::Device& dev, ur::Context& ctx, const ur::
     tess::Painter pt;
 
     // region
-    const float h_sz = TEX_SIZE * 0.5f;
-    pt.AddRect(sm::vec2(-h_sz, -h_sz), sm::vec2(h_sz, h_sz), 0xff0000ff);
+    const float h_w = m_viewport.Width() * 0.5f;
+    const float h_h = m_viewport.Height() * 0.5f;
+    pt.AddRect(sm::vec2(-h_w, -h_h), sm::vec2(h_w, h_h), 0xff0000ff);
 
     // layers
     const float sx = -400;
     const float sy = -350;
     const float size  = 100;
     const float space = 4;
-    auto start = CalcMipmapLevel(m_layers.size(), m_scale);
+    auto start = CalcMipmapLevel(m_layers.size(), m_scale, m_min_level);
     for (size_t i = 0, n = m_layers.size(); i < n; ++i)
     {
         auto& layer = m_layers[i];
+        if (!layer.tex) {
+            continue;
+        }
 
         const float x = sx + (size + space) * i;
         sm::rect region(x, sy, x + size, sy + size);
@@ -388,142 +1237,112 @@ void TextureStack::DrawDebug(const ur::Device& dev, ur::Context& ctx, const ur::
         pt.AddRect(sm::vec2(region.xmin, region.ymin), sm::vec2(region.xmax, region.ymax), 0xff00ff00);
 
         // viewport
-        auto r = CalcUVRegion(i, layer);
-        if (r.xmax > 1.0f) {
-            r.Translate(sm::vec2(1 - r.xmax, 0));
-        }
-        if (r.xmax < 0) {
-            r.Translate(sm::vec2(-r.xmin, 0));
-        }
-        if (r.ymax > 1.0f) {
-            r.Translate(sm::vec2(0, 1 - r.ymax));
-        }
-        if (r.ymax < 0) {
-            r.Translate(sm::vec2(0, -r.ymin));
+        auto r = CalcUVRegion(i, layer, m_cfg.ring_size);
+        if (!r.IsValid()) {
+            continue;
         }
-        auto r_min = sm::vec2(r.xmin, r.ymin) * sm::vec2(region.Width(), region.Height()) + sm::vec2(region.xmin, region.ymin);
-        auto r_max = sm::vec2(r.xmax, r.ymax) * sm::vec2(region.Width(), region.Height()) + sm::vec2(region.xmin, region.ymin);
+
+        // split the wrapped region into its parts inside the ring
         const auto color = i >= start ? 0xff0000ff : 0xff00ff00;
-        pt.AddRect(r_min, r_max, color);
+        for (int ox = 0; ox < 2; ++ox)
+        {
+            for (int oy = 0; oy < 2; ++oy)
+            {
+                sm::rect part;
+                part.xmin = std::max(r.xmin - ox, 0.0f);
+                part.xmax = std::min(r.xmax - ox, 1.0f);
+                part.ymin = std::max(r.ymin - oy, 0.0f);
+                part.ymax = std::min(r.ymax - oy, 1.0f);
+                if (part.xmin >= part.xmax || part.ymin >= part.ymax) {
+                    continue;
+                }
+
+                auto r_min = sm::vec2(part.xmin, part.ymin) * sm::vec2(region.Width(), region.Height()) + sm::vec2(region.xmin, region.ymin);
+                auto r_max = sm::vec2(part.xmax, part.ymax) * sm::vec2(region.Width(), region.Height()) + sm::vec2(region.xmin, region.ymin);
+                pt.AddRect(r_min, r_max, color);
+            }
+        }
+    }
+
+    // mip tail, after the layers
+    if (m_tail.tex)
+    {
+        const float x = sx + (size + space) * m_layers.size();
+        const float w = size * m_tail.width / m_tail.height;
+        sm::rect region(x, sy, x + w, sy + size);
+        pt2::RenderSystem::DrawTexture(dev, ctx, rs, m_tail.tex, region, sm::Matrix2D(), false);
+        pt.AddRect(sm::vec2(region.xmin, region.ymin), sm::vec2(region.xmax, region.ymax), 0xff00ff00);
+    }
+
+    if (m_stats) {
+        DrawStatsPlot(pt);
     }
 
     pt2::RenderSystem::DrawPainter(dev, ctx, rs, pt);
 }
 
-void TextureStack::TraverseDiffPages(const std::vector<sm::rect>& regions, size_t start_layer,
-                                     std::function<void(const textile::Page& page, const sm::rect& region)> cb)
+void TextureStack::DrawStatsPlot(tess::Painter& pt) const
 {
-    assert(regions.size() == m_layers.size() - start_layer);
-    for (size_t i = start_layer, n = m_layers.size(); i < n; ++i)
-    {
-        auto& old_r = m_layers[i].region;
-        auto& new_r = regions[i - start_layer];
-        if (sm::is_rect_contain_rect(old_r, new_r)) {
-            continue;
-        }
+    // one bar per frame, load / copy / draw stacked, in ms
+    const float sx = -400;
+    const float sy = 270;
+    const float bar_w    = 3;
+    const float px_per_ms = 4;
+    const float max_h    = 80;
 
-        if (!old_r.IsValid() || !sm::is_rect_intersect_rect(old_r, new_r)) {
-            TraversePages(new_r, i, cb);
-            continue;
-        }
+    const size_t n = m_stats->GetHistorySize();
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto& frame = m_stats->GetHistory(i);
+        const float x = sx + bar_w * i;
 
-        if (sm::is_rect_contain_rect(new_r, old_r))
-        {
-            TraversePages(sm::rect(new_r.xmin, new_r.ymin, new_r.xmax, old_r.ymin), i, cb);
-            TraversePages(sm::rect(new_r.xmin, old_r.ymax, new_r.xmax, new_r.ymax), i, cb);
-            TraversePages(sm::rect(new_r.xmin, old_r.ymin, old_r.xmin, old_r.ymax), i, cb);
-            TraversePages(sm::rect(old_r.xmax, old_r.ymin, new_r.xmax, old_r.ymax), i, cb);
-        }
-        else if (new_r.xmin <= old_r.xmin && new_r.ymin <= old_r.ymin)
-        {
-            TraversePages(sm::rect(new_r.xmin, new_r.ymin, old_r.xmin, new_r.ymax), i, cb);
-            TraversePages(sm::rect(old_r.xmin, new_r.ymin, new_r.xmax, old_r.ymin), i, cb);
-            if (new_r.ymax > old_r.ymax) {
-                TraversePages(sm::rect(old_r.xmin, old_r.xmax, new_r.xmax, new_r.ymax), i, cb);
-            }
-        }
-        else if (new_r.xmin <= old_r.xmin && new_r.ymax >= old_r.ymax)
-        {
-            TraversePages(sm::rect(new_r.xmin, new_r.ymin, old_r.xmin, new_r.ymax), i, cb);
-            TraversePages(sm::rect(old_r.xmin, old_r.ymax, new_r.xmax, new_r.ymax), i, cb);
-            if (new_r.xmax > old_r.xmax) {
-                TraversePages(sm::rect(old_r.xmax, new_r.ymin, new_r.xmax, new_r.ymax), i, cb);
-            }
-        }
-        else if (new_r.xmax >= old_r.xmax && new_r.ymax >= old_r.ymax)
-        {
-            TraversePages(sm::rect(new_r.xmin, old_r.ymax, new_r.xmax, new_r.ymax), i, cb);
-            TraversePages(sm::rect(old_r.xmax, new_r.ymin, new_r.xmax, old_r.ymax), i, cb);
-            if (new_r.ymin < old_r.ymin) {
-                TraversePages(sm::rect(new_r.xmin, new_r.ymin, old_r.xmax, old_r.ymin), i, cb);
-            }
-        }
-        else if (new_r.xmax >= old_r.xmax && new_r.ymin <= old_r.ymin)
+        const float phases[] = { frame.load_ms, frame.copy_ms, frame.draw_ms };
+        const uint32_t colors[] = { 0xff0000ff, 0xff00ff00, 0xffff0000 };
+        float y = sy;
+        for (int j = 0; j < 3; ++j)
         {
-            TraversePages(sm::rect(new_r.xmin, new_r.ymin, new_r.xmax, old_r.ymin), i, cb);
-            TraversePages(sm::rect(old_r.xmax, old_r.ymin, new_r.xmax, new_r.ymax), i, cb);
-            if (new_r.xmin < old_r.xmin) {
-                TraversePages(sm::rect(new_r.xmin, old_r.ymin, old_r.xmin, new_r.ymax), i, cb);
+            const float h = std::min(phases[j] * px_per_ms, sy + max_h - y);
+            if (h <= 0) {
+                continue;
             }
-        }
-        else if (new_r.xmin < old_r.xmin && new_r.xmax <= old_r.xmax
-              && new_r.ymin >= old_r.ymin && new_r.ymax <= old_r.ymax)
-        {
-            TraversePages(sm::rect(new_r.xmin, new_r.ymin, old_r.xmin, new_r.ymax), i, cb);
-        }
-        else if (new_r.xmax > old_r.xmax && new_r.xmin >= old_r.xmin
-              && new_r.ymin >= old_r.ymin && new_r.ymax <= old_r.ymax)
-        {
-            TraversePages(sm::rect(old_r.xmax, new_r.ymin, new_r.xmax, new_r.ymax), i, cb);
-        }
-        else if (new_r.ymin < old_r.ymin && new_r.ymax <= old_r.ymax
-              && new_r.xmin >= old_r.xmin && new_r.xmax <= old_r.xmax)
-        {
-            TraversePages(sm::rect(new_r.xmin, new_r.ymin, new_r.xmax, old_r.ymin), i, cb);
-        }
-        else if (new_r.ymax > old_r.ymax && new_r.ymin >= old_r.ymin
-              && new_r.xmin >= old_r.xmin && new_r.xmax <= old_r.xmax)
-        {
-            TraversePages(sm::rect(new_r.xmin, old_r.ymax, new_r.xmax, new_r.ymax), i, cb);
-        }
-        else
-        {
-            assert(0);
+            pt.AddRect(sm::vec2(x, y), sm::vec2(x + bar_w, y + h), colors[j]);
+            y += h;
         }
     }
+
+    // 60 fps budget
+    const float budget_y = sy + 16.6f * px_per_ms;
+    pt.AddRect(sm::vec2(sx, budget_y), sm::vec2(sx + bar_w * n, budget_y), 0xffffffff);
 }
 
-void TextureStack::TraversePages(const sm::rect& region, size_t layer,
-                                 std::function<void(const textile::Page& page, const sm::rect& region)> cb)
+size_t TextureStack::CalcRegions(const textile::VTexInfo& info, size_t layer_num,
+                                 const sm::rect& viewport, float& scale, sm::vec2& offset,
+                                 std::vector<sm::rect>& regions, size_t min_level)
 {
-    if (!region.IsValid() || region.Width() == 0 || region.Height() == 0) {
-        return;
-    }
-
-    const float scale = static_cast<float>(std::pow(2, layer));
-    const float layer_w = m_vtex_info.vtex_width * scale;
-    const float layer_h = m_vtex_info.vtex_height * scale;
-    const float tile_sz = m_vtex_info.tile_size * scale;
+    scale = std::min(std::min(info.vtex_width / viewport.Width(), info.vtex_height / viewport.Height()), scale);
+    offset.x = std::max(0.0f, std::min(offset.x, info.vtex_width - viewport.Width() * scale));
+    offset.y = std::max(0.0f, std::min(offset.y, info.vtex_height - viewport.Height() * scale));
 
-    sm::rect r = region;
+    sm::rect region = viewport;
+    region.Scale(sm::vec2(scale, scale));
+    region.Translate(offset);
 
-    int x_begin = static_cast<int>(std::floor(r.xmin / tile_sz));
-    int x_end   = static_cast<int>(std::floor(r.xmax / tile_sz));
-    int y_begin = static_cast<int>(std::floor(r.ymin / tile_sz));
-    int y_end   = static_cast<int>(std::floor(r.ymax / tile_sz));
+    const size_t mipmap_level = CalcMipmapLevel(layer_num, scale);
+    const size_t start_level = std::max(mipmap_level, min_level);
 
-    for (int x = x_begin; x <= x_end; ++x)
+    regions.clear();
+    regions.reserve(layer_num - start_level);
+    auto next_r = region;
+    for (size_t i = start_level, n = layer_num; i < n; ++i)
     {
-        for (int y = y_begin; y <= y_end; ++y)
-        {
-            sm::rect r;
-            r.xmin = std::max(region.xmin, x * tile_sz);
-            r.xmax = std::min(region.xmax, x * tile_sz + tile_sz);
-            r.ymin = std::max(region.ymin, y * tile_sz);
-            r.ymax = std::min(region.ymax, y * tile_sz + tile_sz);
-            cb(textile::Page(x, y, layer), r);
-        }
+        regions.push_back(next_r);
+
+        auto c = next_r.Center();
+        next_r.Scale(sm::vec2(2, 2));
+        next_r.Translate(c - next_r.Center());
     }
+
+    return start_level;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "clipmap/TraceReplay.h"
+#include "clipmap/CameraTrace.h"
+#include "clipmap/CpuClipmap.h"
+#include "clipmap/Clipmap.h"
+#include "clipmap/PageStreamer.h"
+
+#include <textile/PageIndexer.h>
+
+#include <fstream>
+#include <ostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#include <string.h>
+
+namespace
+{
+
+float percentile(const std::vector<float>& sorted, float p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t idx = static_cast<size_t>(std::ceil(p * sorted.size())) - 1;
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void calc_latencies(std::vector<float>& latencies, clipmap::TraceReplay::Report& report)
+{
+    if (latencies.empty()) {
+        return;
+    }
+
+    report.latency_mean = std::accumulate(latencies.begin(), latencies.end(), 0.0f) / latencies.size();
+    std::sort(latencies.begin(), latencies.end());
+    report.latency_p50 = percentile(latencies, 0.5f);
+    report.latency_p90 = percentile(latencies, 0.9f);
+    report.latency_p99 = percentile(latencies, 0.99f);
+    report.latency_max = latencies.back();
+}
+
+}
+
+namespace clipmap
+{
+
+bool TraceReplay::WriteSyntheticVTex(const std::string& filepath,
+                                     const textile::VTexInfo& info)
+{
+    std::ofstream fout(filepath, std::ios::binary);
+    if (!fout.is_open()) {
+        return false;
+    }
+
+    const size_t tile_sz = info.tile_size;
+    const size_t page_bytes = tile_sz * tile_sz * info.channels * info.bytes;
+    const size_t page_count = PageStreamer::CalcPageCount(info);
+
+    textile::PageIndexer indexer(info);
+
+    // PageStreamer expects pages in page index order, each is written at
+    // its index so only one page is in memory
+    std::vector<uint8_t> data(page_bytes);
+
+    size_t w = info.PageTableWidth();
+    size_t h = info.PageTableHeight();
+    const auto mip_count = static_cast<int>(std::log2(std::min(w, h))) + 1;
+    for (int mip = 0; mip < mip_count; ++mip)
+    {
+        for (size_t y = 0; y < h; ++y)
+        {
+            for (size_t x = 0; x < w; ++x)
+            {
+                const textile::Page page(static_cast<int>(x), static_cast<int>(y), mip);
+                const size_t idx = static_cast<size_t>(indexer.CalcPageIdx(page));
+                if (idx >= page_count) {
+                    continue;
+                }
+
+                // page checker, texel gradient, mip tint
+                uint8_t* dst = data.data();
+                const int base = (x + y) % 2 ? 160 : 64;
+                for (size_t py = 0; py < tile_sz; ++py)
+                {
+                    for (size_t px = 0; px < tile_sz; ++px)
+                    {
+                        for (size_t c = 0; c < info.channels; ++c)
+                        {
+                            int v = base;
+                            if (c == 0) {
+                                v += static_cast<int>(px * 64 / tile_sz);
+                            } else if (c == 1) {
+                                v += static_cast<int>(py * 64 / tile_sz);
+                            } else if (c == 2) {
+                                v = mip * 255 / std::max(mip_count - 1, 1);
+                            } else {
+                                v = 255;
+                            }
+
+                            const size_t i = (py * tile_sz + px) * info.channels + c;
+                            if (info.bytes == 2) {
+                                const uint16_t v16 = static_cast<uint16_t>(v * 257);
+                                memcpy(dst + i * 2, &v16, 2);
+                            } else {
+                                dst[i] = static_cast<uint8_t>(v);
+                            }
+                        }
+                    }
+                }
+
+                fout.seekp(idx * page_bytes);
+                fout.write(reinterpret_cast<const char*>(dst), page_bytes);
+            }
+        }
+
+        w = std::max(w / 2, size_t(1));
+        h = std::max(h / 2, size_t(1));
+    }
+
+    return fout.good();
+}
+
+TraceReplay::Report TraceReplay::Run(CpuClipmap& clipmap, const CameraTrace& trace)
+{
+    Report report;
+
+    auto& frames = trace.GetFrames();
+    report.frame_num = frames.size();
+
+    std::vector<float> latencies;
+    latencies.reserve(frames.size());
+    for (auto& frame : frames)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        clipmap.Update(frame.scale, frame.offset);
+        auto end = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<float, std::milli>(end - begin).count());
+
+        auto& stats = clipmap.GetStack().GetUpdateStats();
+        report.pages_requested += stats.pages_requested;
+        report.pages_loaded    += stats.pages_loaded;
+        report.bytes_loaded    += stats.bytes_loaded;
+        report.blits           += stats.blits;
+        report.pages_evicted   += stats.pages_evicted;
+    }
+
+    calc_latencies(latencies, report);
+
+    return report;
+}
+
+TraceReplay::Report TraceReplay::Run(Clipmap& clipmap, const ur::Device& dev,
+                                     ur::Context& ctx, const CameraTrace& trace)
+{
+    Report report;
+    report.gpu = true;
+
+    auto& frames = trace.GetFrames();
+    report.frame_num = frames.size();
+
+    std::vector<float> latencies;
+    latencies.reserve(frames.size());
+    for (auto& frame : frames)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        clipmap.Update(dev, ctx, frame.scale, frame.offset);
+        auto end = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<float, std::milli>(end - begin).count());
+
+        // the frame stays open until the next Update()
+        auto& stats = clipmap.GetStats().GetCurrFrame();
+        report.pages_requested += stats.pages_requested;
+        report.pages_loaded    += stats.pages_uploaded;
+        report.bytes_loaded    += stats.bytes_source;
+        report.blits           += stats.TotalStrips();
+        report.pages_evicted   += stats.evictions;
+        report.cache_hits      += stats.cache_hits;
+        report.cache_misses    += stats.cache_misses;
+        report.bytes_uploaded  += stats.bytes_uploaded;
+        report.draw_calls      += stats.draw_calls;
+    }
+
+    calc_latencies(latencies, report);
+
+    return report;
+}
+
+void TraceReplay::Print(std::ostream& os, const std::string& name, const Report& report)
+{
+    const float n = static_cast<float>(std::max(report.frame_num, size_t(1)));
+    os << std::fixed << std::setprecision(3)
+       << name << ": " << report.frame_num << " frames\n"
+       << "  update ms   mean " << report.latency_mean
+       << "  p50 " << report.latency_p50
+       << "  p90 " << report.latency_p90
+       << "  p99 " << report.latency_p99
+       << "  max " << report.latency_max << "\n"
+       << std::setprecision(1)
+       << "  per frame   requested " << report.pages_requested / n
+       << "  loaded " << report.pages_loaded / n
+       << "  kb " << report.bytes_loaded / n / 1024
+       << "  blits " << report.blits / n
+       << "  evicted " << report.pages_evicted / n << "\n";
+    if (report.gpu)
+    {
+        os << "  gpu frame   hits " << report.cache_hits / n
+           << "  misses " << report.cache_misses / n
+           << "  upload kb " << report.bytes_uploaded / n / 1024
+           << "  draws " << report.draw_calls / n << "\n";
+    }
+}
+
+}
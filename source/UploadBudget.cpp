@@ -0,0 +1,45 @@
+#include "clipmap/UploadBudget.h"
+
+namespace clipmap
+{
+
+void UploadBudget::Set(size_t max_pages, size_t max_bytes, int64_t max_us)
+{
+    m_max_pages = max_pages;
+    m_max_bytes = max_bytes;
+    m_max_us    = max_us;
+}
+
+void UploadBudget::BeginFrame()
+{
+    m_pages = 0;
+    m_bytes = 0;
+    m_begin = std::chrono::steady_clock::now();
+}
+
+void UploadBudget::Consume(size_t bytes)
+{
+    ++m_pages;
+    m_bytes += bytes;
+}
+
+bool UploadBudget::IsExhausted() const
+{
+    if (m_max_pages > 0 && m_pages >= m_max_pages) {
+        return true;
+    }
+    if (m_max_bytes > 0 && m_bytes >= m_max_bytes) {
+        return true;
+    }
+    if (m_max_us > 0)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_begin).count();
+        if (us >= m_max_us) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
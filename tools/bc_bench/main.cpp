@@ -0,0 +1,150 @@
+// block compression round trip, error and encode throughput per format
+// usage: bc_bench [page_size] [page_num] [thread_num]
+
+#include <clipmap/BlockCompress.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+namespace
+{
+
+// terrain like content: smooth ramps, noise and hard edges
+void GenPage(int pattern, int size, int channels, std::mt19937& rng, std::vector<uint8_t>& dst)
+{
+    dst.resize(size * size * channels);
+    std::uniform_int_distribution<int> noise(-12, 12);
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            for (int c = 0; c < channels; ++c)
+            {
+                int v = 0;
+                switch (pattern)
+                {
+                case 0:
+                    v = (x * 255 / size + y * 64 / size + c * 40) & 0xff;
+                    break;
+                case 1:
+                    v = 128 + static_cast<int>(80 * std::sin((x + c * 7) * 0.1f) * std::cos(y * 0.07f)) + noise(rng);
+                    break;
+                case 2:
+                    v = ((x / 8 + y / 8) & 1) ? 230 - c * 30 : 20 + c * 30;
+                    break;
+                }
+                dst[(y * size + x) * channels + c] = static_cast<uint8_t>(std::min(std::max(v, 0), 255));
+            }
+        }
+    }
+}
+
+const char* FormatName(clipmap::BlockCompress::Format fmt)
+{
+    switch (fmt)
+    {
+    case clipmap::BlockCompress::Format::BC1:
+        return "bc1";
+    case clipmap::BlockCompress::Format::BC3:
+        return "bc3";
+    case clipmap::BlockCompress::Format::BC4:
+        return "bc4";
+    case clipmap::BlockCompress::Format::BC5:
+        return "bc5";
+    }
+    return "";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const int page_size  = argc > 1 ? std::atoi(argv[1]) : 128;
+    const int page_num   = argc > 2 ? std::atoi(argv[2]) : 256;
+    const int thread_num = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    if (page_size <= 0 || page_size % 4 != 0 || page_num <= 0) {
+        std::cerr << "page_size must be a multiple of 4\n";
+        return 1;
+    }
+
+    const clipmap::BlockCompress::Format formats[] = {
+        clipmap::BlockCompress::Format::BC1,
+        clipmap::BlockCompress::Format::BC3,
+        clipmap::BlockCompress::Format::BC4,
+        clipmap::BlockCompress::Format::BC5,
+    };
+    const char* pattern_names[] = { "ramp", "noise", "edges" };
+
+    printf("%-4s %-6s %8s %8s %10s %10s\n", "fmt", "page", "psnr", "max_err", "mb/s x1", "mb/s xN");
+
+    std::mt19937 rng(1);
+    bool succ = true;
+    for (auto fmt : formats)
+    {
+        const int channels = clipmap::BlockCompress::SrcChannels(fmt);
+        std::vector<uint8_t> enc(clipmap::BlockCompress::CalcSize(fmt, page_size, page_size));
+        std::vector<uint8_t> dec(page_size * page_size * channels);
+
+        for (int p = 0; p < 3; ++p)
+        {
+            std::vector<uint8_t> src;
+            GenPage(p, page_size, channels, rng, src);
+            // bc1 pages come from rgb, opaque
+            if (fmt == clipmap::BlockCompress::Format::BC1) {
+                for (size_t i = 3, n = src.size(); i < n; i += 4) {
+                    src[i] = 0xff;
+                }
+            }
+
+            // error on one page
+            clipmap::BlockCompress::Encode(fmt, src.data(), page_size, page_size, enc.data());
+            clipmap::BlockCompress::Decode(fmt, enc.data(), page_size, page_size, dec.data());
+            double sq = 0;
+            int max_err = 0;
+            for (size_t i = 0, n = src.size(); i < n; ++i)
+            {
+                const int d = std::abs(static_cast<int>(src[i]) - static_cast<int>(dec[i]));
+                sq += d * d;
+                max_err = std::max(max_err, d);
+            }
+            const double mse = sq / src.size();
+            const double psnr = mse == 0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+
+            // throughput over page_num pages, the way the workers and the
+            // render thread encode them
+            double mbps[2];
+            const int threads[2] = { 1, thread_num };
+            for (int t = 0; t < 2; ++t)
+            {
+                auto begin = std::chrono::steady_clock::now();
+                for (int i = 0; i < page_num; ++i) {
+                    clipmap::BlockCompress::Encode(fmt, src.data(), page_size, page_size, enc.data(), threads[t]);
+                }
+                const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                mbps[t] = sec > 0 ? src.size() * static_cast<double>(page_num) / (1024.0 * 1024.0) / sec : 0;
+            }
+
+            printf("%-4s %-6s %8.2f %8d %10.1f %10.1f\n", FormatName(fmt), pattern_names[p],
+                psnr, max_err, mbps[0], mbps[1]);
+
+            // a broken encoder shows up as a collapsed psnr
+            if (psnr < 20.0) {
+                succ = false;
+            }
+        }
+    }
+
+    if (!succ) {
+        std::cerr << "round trip error too large\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+// PageCodec round trips on page like data, then corrupt and truncated
+// streams, which must fail cleanly instead of reading or writing outside
+// the buffers. run it under asan to catch the latter
+// usage: codec_check [page_bytes] [iterations] [seed]
+
+#include <clipmap/PageCodec.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#include <string.h>
+
+namespace
+{
+
+// 0 zeros, 1 one colour, 2 smooth ramps, 3 noise, 4 repeated short runs
+void GenData(int pattern, size_t size, std::mt19937& rng, std::vector<uint8_t>& dst)
+{
+    dst.resize(size);
+    std::uniform_int_distribution<int> byte(0, 255);
+    switch (pattern)
+    {
+    case 0:
+        memset(dst.data(), 0, size);
+        break;
+    case 1:
+        for (size_t i = 0; i < size; ++i) {
+            dst[i] = static_cast<uint8_t>(0x40 + i % 4 * 0x20);
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < size; ++i) {
+            dst[i] = static_cast<uint8_t>(i / 4 % 256 + (i % 4) * 7);
+        }
+        break;
+    case 3:
+        for (auto& v : dst) {
+            v = static_cast<uint8_t>(byte(rng));
+        }
+        break;
+    case 4:
+    {
+        uint8_t run[7];
+        for (auto& v : run) {
+            v = static_cast<uint8_t>(byte(rng));
+        }
+        for (size_t i = 0; i < size; ++i) {
+            dst[i] = (i / 997) % 2 ? static_cast<uint8_t>(byte(rng)) : run[i % 7];
+        }
+    }
+        break;
+    }
+}
+
+const char* PATTERN_NAMES[] = { "zeros", "colour", "ramp", "noise", "runs" };
+
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t page_bytes = argc > 1 ? std::atoi(argv[1]) : 128 * 128 * 4;
+    const int iterations = argc > 2 ? std::atoi(argv[2]) : 2000;
+    const unsigned seed = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 1;
+
+    std::mt19937 rng(seed);
+    size_t bad = 0;
+
+    // round trips, with ratio and speed
+    printf("%-8s %8s %10s %10s\n", "data", "ratio", "enc mb/s", "dec mb/s");
+    std::vector<uint8_t> src, enc(clipmap::PageCodec::CalcBound(page_bytes)), dec(page_bytes);
+    for (int p = 0; p < 5; ++p)
+    {
+        GenData(p, page_bytes, rng, src);
+
+        const int repeat = 50;
+        size_t enc_size = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i) {
+            enc_size = clipmap::PageCodec::Compress(src.data(), src.size(), enc.data());
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        bool succ = true;
+        for (int i = 0; i < repeat; ++i) {
+            succ &= clipmap::PageCodec::Decompress(enc.data(), enc_size, dec.data(), dec.size());
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        if (!succ || enc_size > enc.size() || dec != src) {
+            ++bad;
+        }
+
+        const double mb = page_bytes * static_cast<double>(repeat) / (1024.0 * 1024.0);
+        printf("%-8s %8.2f %10.1f %10.1f\n", PATTERN_NAMES[p],
+            static_cast<double>(page_bytes) / std::max(enc_size, size_t(1)),
+            mb / std::chrono::duration<double>(t1 - t0).count(),
+            mb / std::chrono::duration<double>(t2 - t1).count());
+    }
+
+    // random sizes, including 0 and ones below the minimum match
+    std::uniform_int_distribution<size_t> small(0, 64);
+    std::uniform_int_distribution<int> pattern(0, 4);
+    for (int i = 0; i < iterations; ++i)
+    {
+        const size_t size = i % 2 ? small(rng) : small(rng) * 997 % page_bytes;
+        GenData(pattern(rng), size, rng, src);
+        std::vector<uint8_t> e(clipmap::PageCodec::CalcBound(size));
+        const size_t n = clipmap::PageCodec::Compress(src.data(), size, e.data());
+        std::vector<uint8_t> d(size);
+        if (n > e.size() || !clipmap::PageCodec::Decompress(e.data(), n, d.data(), d.size()) || d != src) {
+            ++bad;
+        }
+    }
+
+    // damaged streams: truncated, bytes flipped, wrong output size. a
+    // flip may still decode to the right size, only crashes and overruns
+    // are errors, guard bytes catch writes past dst
+    const uint8_t GUARD = 0xcd;
+    size_t rejected = 0, damaged = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        GenData(pattern(rng), page_bytes, rng, src);
+        const size_t n = clipmap::PageCodec::Compress(src.data(), src.size(), enc.data());
+
+        std::vector<uint8_t> broken(enc.begin(), enc.begin() + n);
+        size_t dst_size = page_bytes;
+        switch (i % 3)
+        {
+        case 0:
+            broken.resize(std::uniform_int_distribution<size_t>(0, n - 1)(rng));
+            break;
+        case 1:
+            for (int k = 0; k < 4; ++k) {
+                broken[std::uniform_int_distribution<size_t>(0, n - 1)(rng)] ^= static_cast<uint8_t>(1 << (k * 2));
+            }
+            break;
+        case 2:
+            dst_size = std::uniform_int_distribution<size_t>(0, page_bytes - 1)(rng);
+            break;
+        }
+
+        std::vector<uint8_t> out(dst_size + 64, GUARD);
+        const bool succ = clipmap::PageCodec::Decompress(broken.data(), broken.size(), out.data(), dst_size);
+        ++damaged;
+        if (!succ) {
+            ++rejected;
+        }
+        // truncated or resized streams can't give exactly dst_size bytes
+        if (succ && i % 3 != 1) {
+            ++bad;
+        }
+        for (size_t k = dst_size; k < out.size(); ++k) {
+            if (out[k] != GUARD) {
+                ++bad;
+                break;
+            }
+        }
+    }
+
+    std::cout << "damaged " << damaged << ", rejected " << rejected << ", bad " << bad << "\n";
+    return bad == 0 ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+// GeometryClipmap on the cpu along a pan with a zoom step: height error
+// at the seams between rings, triangle count and heights sampled per frame
+// usage: geometry_check [grid_size] [frame_num]
+
+#include <clipmap/GeometryClipmap.h>
+#include <clipmap/TextureStack.h>
+
+#include <textile/VTexInfo.h>
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+namespace
+{
+
+const size_t LEVEL_NUM = 10;
+
+// final height of a ring at a point on its grid lines, linear along the
+// cell edges the way the rasterizer interpolates it
+float RingHeight(const clipmap::GeometryClipmap::Ring& ring, int n, float spacing, float x, float y)
+{
+    const float fi = x / spacing - ring.origin_x;
+    const float fj = y / spacing - ring.origin_y;
+    int i = static_cast<int>(std::floor(fi));
+    int j = static_cast<int>(std::floor(fj));
+    float tx = fi - i, ty = fj - j;
+    if (i == n - 1) {
+        i = n - 2;
+        tx = 1;
+    }
+    if (j == n - 1) {
+        j = n - 2;
+        ty = 1;
+    }
+
+    auto h = [&](int a, int b) { return ring.verts[b * n + a].FinalHeight(); };
+    const float top = h(i, j) + (h(i + 1, j) - h(i, j)) * tx;
+    const float bot = h(i, j + 1) + (h(i + 1, j + 1) - h(i, j + 1)) * tx;
+    return top + (bot - top) * ty;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const int grid_size = argc > 1 ? std::atoi(argv[1]) : 31;
+    const int frame_num = argc > 2 ? std::atoi(argv[2]) : 200;
+
+    textile::VTexInfo info;
+    info.vtex_width  = 65536;
+    info.vtex_height = 65536;
+    info.tile_size   = 128;
+
+    // smooth terrain, a different offset per level like mip data would have
+    auto sampler = [](size_t level, float x, float y) {
+        return std::sin(x * 0.01f + level) * 40 + std::cos(y * 0.013f) * 30 + level * 3.0f;
+    };
+
+    clipmap::GeometryClipmap geo(grid_size, 1.0f, 0);
+
+    const sm::rect viewport(0, 0, 512, 512);
+    float scale = 3;
+    sm::vec2 offset(20000, 20000);
+    const int zoom_frame = frame_num / 2;
+
+    double max_seam_err = 0;
+    size_t tri_num = 0, samples_total = 0, samples_max = 0, full_samples = 0;
+    bool tri_const = true;
+    for (int f = 0; f < frame_num; ++f)
+    {
+        if (f == zoom_frame) {
+            scale *= 3;
+        }
+        offset.x += 7.3f * scale;
+        offset.y += 3.1f * scale;
+
+        float s = scale;
+        sm::vec2 o = offset;
+        std::vector<sm::rect> regions;
+        const size_t level = clipmap::TextureStack::CalcRegions(info, LEVEL_NUM, viewport, s, o, regions);
+        std::vector<sm::rect> all(LEVEL_NUM);
+        for (size_t i = level; i < LEVEL_NUM; ++i) {
+            all[i] = regions[i - level];
+        }
+        geo.Update(all, level, sampler);
+
+        // outer border of each ring against the next coarser ring
+        auto& rings = geo.GetRings();
+        for (size_t r = 0; r + 1 < rings.size(); ++r)
+        {
+            auto& fine = rings[r];
+            auto& coarse = rings[r + 1];
+            const float spacing = std::pow(2.0f, static_cast<float>(fine.level));
+            for (int k = 0; k < grid_size; ++k)
+            {
+                const int pts[4][2] = { { k, 0 }, { k, grid_size - 1 }, { 0, k }, { grid_size - 1, k } };
+                for (auto& p : pts)
+                {
+                    auto& v = fine.verts[p[1] * grid_size + p[0]];
+                    const float h = RingHeight(coarse, grid_size, spacing * 2, v.x, v.y);
+                    max_seam_err = std::max(max_seam_err, static_cast<double>(std::fabs(h - v.FinalHeight())));
+                }
+            }
+        }
+
+        // the ring count only changes with the zoom
+        if (f == 0 || f == zoom_frame) {
+            tri_num = geo.GetTriangleCount();
+            full_samples = geo.GetSampleCount();
+        } else if (geo.GetTriangleCount() != tri_num) {
+            tri_const = false;
+        }
+        if (f != 0 && f != zoom_frame)
+        {
+            samples_total += geo.GetSampleCount();
+            samples_max = std::max(samples_max, geo.GetSampleCount());
+        }
+    }
+
+    const size_t moved_frames = std::max(frame_num - 2, 1);
+    printf("rings %zu  triangles %zu  constant %s\n", geo.GetRings().size(), tri_num, tri_const ? "yes" : "no");
+    printf("samples per frame  full %zu  mean %.1f  max %zu\n", full_samples,
+        static_cast<double>(samples_total) / moved_frames, samples_max);
+    printf("max seam error %g\n", max_seam_err);
+
+    // seams within float noise, and a pan only samples the exposed strips
+    const bool succ = tri_const && max_seam_err < 1e-3 && samples_max < full_samples;
+    if (!succ) {
+        std::cerr << "geometry clipmap check failed\n";
+        return 1;
+    }
+    return 0;
+}
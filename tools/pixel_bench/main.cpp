@@ -0,0 +1,144 @@
+// PixelConvert kernels against plain loops, checks the output and
+// prints MB/s of source data for both
+// usage: pixel_bench [page_size] [repeat]
+
+#include <clipmap/PixelConvert.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstdio>
+
+#include <string.h>
+
+namespace
+{
+
+double MeasureMBps(size_t src_bytes, int repeat, const std::function<void()>& func)
+{
+    func();
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) {
+        func();
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return sec > 0 ? src_bytes * static_cast<double>(repeat) / (1024.0 * 1024.0) / sec : 0;
+}
+
+bool Report(const char* name, size_t src_bytes, int repeat, bool same,
+            const std::function<void()>& kernel, const std::function<void()>& plain)
+{
+    const double k = MeasureMBps(src_bytes, repeat, kernel);
+    const double p = MeasureMBps(src_bytes, repeat, plain);
+    printf("%-16s %10.1f %10.1f %7.2fx  %s\n", name, k, p, p > 0 ? k / p : 0, same ? "ok" : "MISMATCH");
+    return same;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t page_size = argc > 1 ? std::atoi(argv[1]) : 256;
+    const int    repeat    = argc > 2 ? std::atoi(argv[2]) : 200;
+    const size_t pixel_n   = page_size * page_size;
+
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    std::vector<uint8_t> rgb(pixel_n * 3), rgba(pixel_n * 4);
+    for (auto& v : rgb) {
+        v = static_cast<uint8_t>(byte(rng));
+    }
+    for (auto& v : rgba) {
+        v = static_cast<uint8_t>(byte(rng));
+    }
+    std::vector<uint16_t> u16(pixel_n * 4);
+    for (auto& v : u16) {
+        v = static_cast<uint16_t>(byte(rng) * 257 + byte(rng));
+    }
+    // worst case for the early out, equal up to the last byte
+    std::vector<uint8_t> flat(pixel_n * 4, 0x5a);
+    flat.back() = 0x5b;
+
+    printf("%-16s %10s %10s %8s\n", "kernel", "mb/s", "plain", "speedup");
+
+    bool succ = true;
+
+    std::vector<uint8_t> out_k(pixel_n * 4), out_p(pixel_n * 4);
+    auto rgb2rgba = [&]() {
+        clipmap::PixelConvert::RGB2RGBA(rgb.data(), out_k.data(), pixel_n);
+    };
+    auto rgb2rgba_plain = [&]() {
+        for (size_t i = 0; i < pixel_n; ++i)
+        {
+            out_p[i * 4]     = rgb[i * 3];
+            out_p[i * 4 + 1] = rgb[i * 3 + 1];
+            out_p[i * 4 + 2] = rgb[i * 3 + 2];
+            out_p[i * 4 + 3] = 0xff;
+        }
+    };
+    rgb2rgba();
+    rgb2rgba_plain();
+    succ &= Report("rgb2rgba", rgb.size(), repeat, out_k == out_p, rgb2rgba, rgb2rgba_plain);
+
+    auto u16_to_u8 = [&]() {
+        clipmap::PixelConvert::U16ToU8(u16.data(), out_k.data(), u16.size());
+    };
+    auto u16_to_u8_plain = [&]() {
+        for (size_t i = 0, n = u16.size(); i < n; ++i) {
+            out_p[i] = static_cast<uint8_t>(u16[i] >> 8);
+        }
+    };
+    u16_to_u8();
+    u16_to_u8_plain();
+    succ &= Report("u16_to_u8", u16.size() * 2, repeat, out_k == out_p, u16_to_u8, u16_to_u8_plain);
+
+    bool uniform_k = true, uniform_p = true;
+    auto is_uniform = [&]() {
+        uniform_k = clipmap::PixelConvert::IsUniform(flat.data(), flat.size(), 4);
+    };
+    auto is_uniform_plain = [&]() {
+        uniform_p = true;
+        for (size_t i = 4, n = flat.size(); i < n && uniform_p; ++i) {
+            uniform_p = flat[i] == flat[i - 4];
+        }
+    };
+    is_uniform();
+    is_uniform_plain();
+    succ &= Report("is_uniform", flat.size(), repeat, uniform_k == uniform_p && !uniform_k, is_uniform, is_uniform_plain);
+
+    const size_t row_bytes = page_size * 4;
+    const size_t half = page_size / 2;
+    auto downsample = [&]() {
+        for (size_t y = 0; y < half; ++y) {
+            clipmap::PixelConvert::Downsample2x2(&rgba[y * 2 * row_bytes], &rgba[(y * 2 + 1) * row_bytes],
+                &out_k[y * half * 4], half, 4);
+        }
+    };
+    auto downsample_plain = [&]() {
+        for (size_t y = 0; y < half; ++y)
+        {
+            const uint8_t* r0 = &rgba[y * 2 * row_bytes];
+            const uint8_t* r1 = &rgba[(y * 2 + 1) * row_bytes];
+            for (size_t x = 0; x < half; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    out_p[(y * half + x) * 4 + c] = static_cast<uint8_t>(
+                        (r0[x * 8 + c] + r0[x * 8 + 4 + c] + r1[x * 8 + c] + r1[x * 8 + 4 + c] + 2) >> 2);
+                }
+            }
+        }
+    };
+    downsample();
+    downsample_plain();
+    succ &= Report("downsample_rgba", rgba.size(), repeat,
+        memcmp(out_k.data(), out_p.data(), half * half * 4) == 0, downsample, downsample_plain);
+
+    if (!succ) {
+        std::cerr << "kernel output differs from the plain loop\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// random rect pairs through RectDiff, checked against brute force
+// sampling of the pages on a grid
+// usage: rect_diff_check [pair_num] [seed]
+
+#include <clipmap/RectDiff.h>
+
+#include <textile/VTexInfo.h>
+
+#include <iostream>
+#include <random>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+
+const int VTEX_SIZE = 4096;
+const int TILE_SIZE = 64;
+// samples per page side
+const int GRID = 16;
+
+bool contains(const sm::rect& r, float x, float y)
+{
+    return r.IsValid() && x >= r.xmin && x < r.xmax && y >= r.ymin && y < r.ymax;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const int pair_num = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const unsigned seed = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 1;
+
+    textile::VTexInfo info;
+    info.vtex_width  = VTEX_SIZE;
+    info.vtex_height = VTEX_SIZE;
+    info.tile_size   = TILE_SIZE;
+
+    std::mt19937 rng(seed);
+    // regions also grow past the texture border
+    std::uniform_real_distribution<float> pos(-500, VTEX_SIZE + 500);
+    std::uniform_real_distribution<float> size(1, 1500);
+    std::uniform_real_distribution<float> move(-500, 500);
+
+    size_t bad_parts = 0, bad_pages = 0, bad_order = 0, bad_regions = 0;
+    for (int i = 0; i < pair_num; ++i)
+    {
+        const float x = pos(rng), y = pos(rng);
+        const sm::rect new_r(x, y, x + size(rng), y + size(rng));
+
+        // cold start, or a move from a nearby region of another size
+        sm::rect old_r;
+        if (i % 5 != 0)
+        {
+            const float ox = x + move(rng), oy = y + move(rng);
+            old_r = sm::rect(ox, oy, ox + size(rng), oy + size(rng));
+        }
+
+        const int layer = i % 3;
+        const float tile_sz = static_cast<float>(TILE_SIZE * std::pow(2, layer));
+
+        // parts cover new - old, once and nothing else
+        sm::rect parts[4];
+        const int part_n = clipmap::RectDiff::Subtract(new_r, old_r, parts);
+        std::uniform_real_distribution<float> sx(new_r.xmin - 10, new_r.xmax + 10);
+        std::uniform_real_distribution<float> sy(new_r.ymin - 10, new_r.ymax + 10);
+        for (int s = 0; s < 64; ++s)
+        {
+            const float px = sx(rng), py = sy(rng);
+            int hits = 0;
+            for (int k = 0; k < part_n; ++k) {
+                hits += contains(parts[k], px, py) ? 1 : 0;
+            }
+            const bool expect = contains(new_r, px, py) && !contains(old_r, px, py);
+            if (hits != (expect ? 1 : 0)) {
+                ++bad_parts;
+            }
+        }
+
+        clipmap::RectDiff::PageSet pages;
+        clipmap::RectDiff::CalcDiffPages(info, old_r, new_r, layer, pages);
+
+        // unique, in row order, regions inside their page and new_r
+        std::set<std::pair<int, int>> got;
+        for (size_t k = 0; k < pages.size(); ++k)
+        {
+            auto& p = pages[k];
+            got.insert({ p.page.y, p.page.x });
+            if (k > 0)
+            {
+                auto& prev = pages[k - 1].page;
+                if (!(prev.y < p.page.y || (prev.y == p.page.y && prev.x < p.page.x))) {
+                    ++bad_order;
+                }
+            }
+            const bool inside = p.region.xmin >= p.page.x * tile_sz && p.region.xmax <= (p.page.x + 1) * tile_sz
+                             && p.region.ymin >= p.page.y * tile_sz && p.region.ymax <= (p.page.y + 1) * tile_sz
+                             && p.region.xmin >= new_r.xmin && p.region.xmax <= new_r.xmax
+                             && p.region.ymin >= new_r.ymin && p.region.ymax <= new_r.ymax;
+            if (!inside || p.page.mip != layer) {
+                ++bad_regions;
+            }
+        }
+
+        // every page with a sample in new - old is there. merged corner
+        // pages may cover a little more, so extra pages are allowed
+        // only pages around new_r can have such samples
+        const int page_n = static_cast<int>(VTEX_SIZE / tile_sz);
+        const int x0 = std::max(static_cast<int>(std::floor(new_r.xmin / tile_sz)), 0);
+        const int y0 = std::max(static_cast<int>(std::floor(new_r.ymin / tile_sz)), 0);
+        const int x1 = std::min(static_cast<int>(std::ceil(new_r.xmax / tile_sz)), page_n);
+        const int y1 = std::min(static_cast<int>(std::ceil(new_r.ymax / tile_sz)), page_n);
+        for (int py = y0; py < y1; ++py)
+        {
+            for (int px = x0; px < x1; ++px)
+            {
+                bool hit = false;
+                for (int gy = 0; gy < GRID && !hit; ++gy)
+                {
+                    for (int gx = 0; gx < GRID && !hit; ++gx)
+                    {
+                        const float X = px * tile_sz + (gx + 0.5f) * tile_sz / GRID;
+                        const float Y = py * tile_sz + (gy + 0.5f) * tile_sz / GRID;
+                        hit = contains(new_r, X, Y) && !contains(old_r, X, Y);
+                    }
+                }
+                if (hit && got.find({ py, px }) == got.end()) {
+                    ++bad_pages;
+                }
+            }
+        }
+    }
+
+    std::cout << pair_num << " pairs, bad parts " << bad_parts << ", missing pages " << bad_pages
+              << ", bad order " << bad_order << ", bad regions " << bad_regions << "\n";
+    return bad_parts + bad_pages + bad_order + bad_regions == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+// unirender device and context that accept every call and draw nothing,
+// so the gpu Clipmap runs its cache, uploads and stats without a window
+
+#include <unirender/Device.h>
+#include <unirender/Context.h>
+#include <unirender/Texture.h>
+#include <unirender/Framebuffer.h>
+#include <unirender/ShaderProgram.h>
+#include <unirender/Uniform.h>
+#include <unirender/VertexArray.h>
+#include <unirender/DrawState.h>
+
+#include <memory>
+
+namespace trace_bench
+{
+
+class NullTexture : public ur::Texture
+{
+public:
+    NullTexture(int width, int height)
+        : m_width(width), m_height(height) {}
+
+    int GetWidth() const override { return m_width; }
+    int GetHeight() const override { return m_height; }
+    void Upload(const void* pixels, int x, int y, int w, int h,
+        int miplevel, int row_alignment) override {}
+
+private:
+    int m_width, m_height;
+
+}; // NullTexture
+
+class NullFramebuffer : public ur::Framebuffer
+{
+public:
+    void SetAttachment(ur::AttachmentType type, ur::TextureTarget target,
+        const ur::TexturePtr& tex, void* ud) override {}
+
+}; // NullFramebuffer
+
+class NullUniform : public ur::Uniform
+{
+public:
+    void SetValue(const float* v, int n) override {}
+    void SetValue(const int* v, int n) override {}
+
+}; // NullUniform
+
+class NullShaderProgram : public ur::ShaderProgram
+{
+public:
+    int QueryTexSlot(const std::string& name) const override { return 0; }
+    ur::UniformPtr QueryUniform(const std::string& name) const override {
+        return std::make_shared<NullUniform>();
+    }
+
+}; // NullShaderProgram
+
+class NullVertexBuffer : public ur::VertexBuffer
+{
+public:
+    void Reserve(int size) override {}
+    void ReadFromMemory(const void* data, int size, int offset) override {}
+
+}; // NullVertexBuffer
+
+class NullVertexArray : public ur::VertexArray
+{
+public:
+    NullVertexArray()
+        : m_vbuf(std::make_shared<NullVertexBuffer>()) {}
+
+    void SetVertexBuffer(const std::shared_ptr<ur::VertexBuffer>& vbuf) override {
+        m_vbuf = vbuf;
+    }
+    void SetVertexBufferAttrs(const std::vector<std::shared_ptr<ur::VertexInputAttribute>>& attrs) override {}
+    std::shared_ptr<ur::VertexBuffer> GetVertexBuffer() const override { return m_vbuf; }
+
+private:
+    std::shared_ptr<ur::VertexBuffer> m_vbuf;
+
+}; // NullVertexArray
+
+// only what clipmap calls is overridden
+class NullDevice : public ur::Device
+{
+public:
+    ur::TexturePtr CreateTexture(const ur::TextureDescription& desc,
+        const void* data) const override {
+        return std::make_shared<NullTexture>(desc.width, desc.height);
+    }
+    std::shared_ptr<ur::ShaderProgram> CreateShaderProgram(const std::vector<unsigned int>& vs,
+        const std::vector<unsigned int>& fs) const override {
+        return std::make_shared<NullShaderProgram>();
+    }
+    std::shared_ptr<ur::Framebuffer> CreateFramebuffer() const override {
+        return std::make_shared<NullFramebuffer>();
+    }
+    std::shared_ptr<ur::VertexArray> GetVertexArray(PrimitiveType prim,
+        ur::VertexLayoutType layout) const override {
+        return std::make_shared<NullVertexArray>();
+    }
+    std::shared_ptr<ur::VertexArray> CreateVertexArray() const override {
+        return std::make_shared<NullVertexArray>();
+    }
+    std::shared_ptr<ur::VertexBuffer> CreateVertexBuffer(ur::BufferUsageHint usage,
+        int size) const override {
+        return std::make_shared<NullVertexBuffer>();
+    }
+
+}; // NullDevice
+
+class NullContext : public ur::Context
+{
+public:
+    void SetViewport(int x, int y, int w, int h) override {}
+    void SetFramebuffer(const std::shared_ptr<ur::Framebuffer>& fbo) override {}
+    void SetTexture(int slot, const ur::TexturePtr& tex) override {}
+    void Draw(ur::PrimitiveType prim, const ur::DrawState& ds, const void* ud) override {}
+
+}; // NullContext
+
+}
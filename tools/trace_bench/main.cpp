@@ -0,0 +1,76 @@
+// replay synthetic camera traces through the cpu clipmap and through the
+// gpu Clipmap on a null device
+// usage: trace_bench [vtex_size] [thread_num] [vtex_path] [trace_file]
+// the page file is written to vtex_path, the temp directory by default,
+// and removed at the end
+
+#include "NullDevice.h"
+
+#include <clipmap/Clipmap.h>
+#include <clipmap/CpuClipmap.h>
+#include <clipmap/CameraTrace.h>
+#include <clipmap/TraceReplay.h>
+
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+int main(int argc, char* argv[])
+{
+    const size_t vtex_size  = argc > 1 ? std::atoi(argv[1]) : 2048;
+    const size_t thread_num = argc > 2 ? std::atoi(argv[2]) : 0;
+
+    textile::VTexInfo info;
+    info.vtex_width  = vtex_size;
+    info.vtex_height = vtex_size;
+    info.tile_size   = 128;
+    info.channels    = 4;
+    info.bytes       = 1;
+
+    const std::string filepath = argc > 3 ? argv[3]
+        : (std::filesystem::temp_directory_path() / "trace_bench.vtex").string();
+    if (!clipmap::TraceReplay::WriteSyntheticVTex(filepath, info)) {
+        std::cerr << "fail to write " << filepath << "\n";
+        return 1;
+    }
+
+    const float sz = static_cast<float>(vtex_size);
+    const sm::vec2 center(sz * 0.5f, sz * 0.5f);
+
+    std::vector<std::pair<std::string, clipmap::CameraTrace>> traces;
+    traces.emplace_back("linear pan", clipmap::CameraTrace::LinearPan(600, 1, sm::vec2(0, sz * 0.25f), sm::vec2(16, 4)));
+    traces.emplace_back("zoom dive", clipmap::CameraTrace::ZoomDive(600, center, sz / 512, 1));
+    traces.emplace_back("random jumps", clipmap::CameraTrace::RandomJumps(200, sm::vec2(sz, sz), 1, sz / 512));
+    traces.emplace_back("orbit", clipmap::CameraTrace::Orbit(600, center, sz * 0.25f, 2));
+    if (argc > 4)
+    {
+        clipmap::CameraTrace recorded;
+        if (recorded.Load(argv[4])) {
+            traces.emplace_back(argv[4], recorded);
+        }
+    }
+
+    trace_bench::NullDevice dev;
+    trace_bench::NullContext ctx;
+
+    for (auto& trace : traces)
+    {
+        // fresh clipmaps, so every trace starts cold
+        clipmap::CpuClipmap cpu(filepath, info, thread_num);
+        auto report = clipmap::TraceReplay::Run(cpu, trace.second);
+        clipmap::TraceReplay::Print(std::cout, trace.first + " (cpu)", report);
+
+        // the synthetic file has no header, only the streamer reads it
+        clipmap::Clipmap gpu(filepath, info, std::max(thread_num, size_t(1)));
+        gpu.Init(dev);
+        report = clipmap::TraceReplay::Run(gpu, dev, ctx, trace.second);
+        clipmap::TraceReplay::Print(std::cout, trace.first + " (gpu)", report);
+    }
+
+    std::remove(filepath.c_str());
+
+    return 0;
+}
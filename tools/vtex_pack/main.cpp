@@ -0,0 +1,300 @@
+// pack a raw image into a vtex page file with all levels, the pages of a
+// level in Morton order and an offset index, see clipmap::PageFile
+// the source is read one page row at a time, so it can be larger than ram
+// usage: vtex_pack src.raw width height channels bytes dst.vtex [tile_size] [thread_num]
+
+#include <clipmap/PageFile.h>
+#include <clipmap/PageStreamer.h>
+#include <clipmap/PixelConvert.h>
+
+#include <textile/PageIndexer.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include <string.h>
+
+namespace
+{
+
+// split [0, n) over the threads
+template <typename Func>
+void parallel_for(size_t n, size_t thread_num, Func func)
+{
+    thread_num = std::max(size_t(1), std::min(thread_num, n));
+    if (thread_num == 1) {
+        func(0, n);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_num);
+    const size_t step = (n + thread_num - 1) / thread_num;
+    for (size_t begin = 0; begin < n; begin += step) {
+        threads.emplace_back(func, begin, std::min(begin + step, n));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+// rows go in at level 0, each full band of tile_size rows is cut into
+// pages and downsampled into the next level
+class Packer
+{
+public:
+    Packer(const textile::VTexInfo& info, std::ofstream& fout, size_t thread_num)
+        : m_info(info)
+        , m_indexer(info)
+        , m_fout(fout)
+        , m_thread_num(thread_num)
+    {
+        m_pixel_bytes = info.channels * info.bytes;
+        m_page_bytes  = clipmap::PageFile::CalcPageBytes(info);
+        m_page_count  = clipmap::PageStreamer::CalcPageCount(info);
+        clipmap::PageFile::CalcPackedOrder(info, m_ranks);
+
+        size_t w = info.PageTableWidth();
+        size_t h = info.PageTableHeight();
+        const auto mip_count = static_cast<int>(std::log2(std::min(w, h))) + 1;
+        m_levels.resize(mip_count);
+        for (auto& level : m_levels)
+        {
+            level.page_w = w;
+            level.page_h = h;
+            level.band.resize(w * info.tile_size * info.tile_size * m_pixel_bytes);
+            w = std::max(w / 2, size_t(1));
+            h = std::max(h / 2, size_t(1));
+        }
+
+        m_page_buf.resize(m_page_bytes);
+    }
+
+    size_t GetRowBytes() const {
+        return m_levels[0].page_w * m_info.tile_size * m_pixel_bytes;
+    }
+
+    bool AddRow(const uint8_t* row) {
+        return AddRow(0, row);
+    }
+
+    // offsets by page index and the footer after the pages
+    bool Finish()
+    {
+        std::vector<uint64_t> offsets(m_page_count);
+        for (size_t i = 0; i < m_page_count; ++i) {
+            offsets[i] = m_ranks[i] * m_page_bytes;
+        }
+
+        const uint64_t index_offset = m_page_count * m_page_bytes;
+        m_fout.seekp(index_offset);
+        m_fout.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+        clipmap::PageFile::Footer footer;
+        clipmap::PageFile::InitFooter(m_info, index_offset, footer);
+        m_fout.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+        return m_fout.good();
+    }
+
+    size_t GetLevelNum() const { return m_levels.size(); }
+
+private:
+    struct Level
+    {
+        size_t page_w = 0, page_h = 0;
+
+        // tile_size rows of the current page row
+        std::vector<uint8_t> band;
+        size_t band_rows = 0;
+        size_t page_y = 0;
+    };
+
+    bool AddRow(size_t mip, const uint8_t* row)
+    {
+        auto& level = m_levels[mip];
+        // rows past the last full page row of a level are dropped, as
+        // the page tables round down
+        if (level.page_y >= level.page_h) {
+            return true;
+        }
+
+        const size_t row_bytes = level.page_w * m_info.tile_size * m_pixel_bytes;
+        memcpy(&level.band[level.band_rows * row_bytes], row, row_bytes);
+        if (++level.band_rows < m_info.tile_size) {
+            return true;
+        }
+
+        if (!WritePageRow(mip)) {
+            return false;
+        }
+
+        if (mip + 1 < m_levels.size())
+        {
+            // half the band into the next level, rows split over the threads
+            auto& next = m_levels[mip + 1];
+            const size_t dst_w = next.page_w * m_info.tile_size;
+            const size_t dst_row_bytes = dst_w * m_pixel_bytes;
+            const size_t dst_rows = m_info.tile_size / 2;
+            // own buffer, the next level may downsample in turn
+            std::vector<uint8_t> half_band(dst_rows * dst_row_bytes);
+            parallel_for(dst_rows, m_thread_num, [&](size_t begin, size_t end)
+            {
+                for (size_t y = begin; y < end; ++y)
+                {
+                    const uint8_t* r0 = &level.band[y * 2 * row_bytes];
+                    const uint8_t* r1 = r0 + row_bytes;
+                    uint8_t* dst = &half_band[y * dst_row_bytes];
+                    const int channels = static_cast<int>(m_info.channels);
+                    if (m_info.bytes == 2) {
+                        clipmap::PixelConvert::Downsample2x2(reinterpret_cast<const uint16_t*>(r0),
+                            reinterpret_cast<const uint16_t*>(r1), reinterpret_cast<uint16_t*>(dst), dst_w, channels);
+                    } else {
+                        clipmap::PixelConvert::Downsample2x2(r0, r1, dst, dst_w, channels);
+                    }
+                }
+            });
+
+            for (size_t y = 0; y < dst_rows; ++y) {
+                if (!AddRow(mip + 1, &half_band[y * dst_row_bytes])) {
+                    return false;
+                }
+            }
+        }
+
+        level.band_rows = 0;
+        ++level.page_y;
+        return true;
+    }
+
+    bool WritePageRow(size_t mip)
+    {
+        auto& level = m_levels[mip];
+        const size_t tile_sz = m_info.tile_size;
+        const size_t row_bytes = level.page_w * tile_sz * m_pixel_bytes;
+        const size_t page_row_bytes = tile_sz * m_pixel_bytes;
+        for (size_t x = 0; x < level.page_w; ++x)
+        {
+            const textile::Page page(static_cast<int>(x), static_cast<int>(level.page_y), static_cast<int>(mip));
+            const size_t idx = static_cast<size_t>(m_indexer.CalcPageIdx(page));
+            if (idx >= m_page_count) {
+                continue;
+            }
+
+            for (size_t y = 0; y < tile_sz; ++y) {
+                memcpy(&m_page_buf[y * page_row_bytes], &level.band[y * row_bytes + x * page_row_bytes], page_row_bytes);
+            }
+
+            m_fout.seekp(m_ranks[idx] * m_page_bytes);
+            m_fout.write(reinterpret_cast<const char*>(m_page_buf.data()), m_page_bytes);
+        }
+        return m_fout.good();
+    }
+
+private:
+    const textile::VTexInfo& m_info;
+    textile::PageIndexer m_indexer;
+
+    std::ofstream& m_fout;
+    size_t m_thread_num = 1;
+
+    size_t m_pixel_bytes = 0;
+    size_t m_page_bytes  = 0;
+    size_t m_page_count  = 0;
+
+    // Morton rank by page index, pages are written at rank * page bytes
+    std::vector<uint64_t> m_ranks;
+
+    std::vector<Level> m_levels;
+
+    std::vector<uint8_t> m_page_buf;
+
+}; // Packer
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 7)
+    {
+        std::cerr << "usage: vtex_pack src.raw width height channels bytes dst.vtex [tile_size] [thread_num]\n";
+        return 1;
+    }
+
+    const size_t src_w    = std::atoi(argv[2]);
+    const size_t src_h    = std::atoi(argv[3]);
+    const size_t channels = std::atoi(argv[4]);
+    const size_t bytes    = std::atoi(argv[5]);
+    const std::string dst_path = argv[6];
+    const size_t tile_size  = argc > 7 ? std::atoi(argv[7]) : 128;
+    const size_t thread_num = argc > 8 ? std::atoi(argv[8]) : std::thread::hardware_concurrency();
+
+    if (src_w == 0 || src_h == 0 || channels < 1 || channels > 4 || (bytes != 1 && bytes != 2) || tile_size < 2)
+    {
+        std::cerr << "bad image layout\n";
+        return 1;
+    }
+
+    std::ifstream fin(argv[1], std::ios::binary);
+    if (!fin.is_open()) {
+        std::cerr << "fail to open " << argv[1] << "\n";
+        return 1;
+    }
+    std::ofstream fout(dst_path, std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) {
+        std::cerr << "fail to open " << dst_path << "\n";
+        return 1;
+    }
+
+    // whole pages, the right and bottom edges are repeated into the last ones
+    textile::VTexInfo info;
+    info.vtex_width  = (src_w + tile_size - 1) / tile_size * tile_size;
+    info.vtex_height = (src_h + tile_size - 1) / tile_size * tile_size;
+    info.tile_size   = tile_size;
+    info.channels    = channels;
+    info.bytes       = bytes;
+
+    auto begin = std::chrono::steady_clock::now();
+
+    Packer packer(info, fout, std::max(thread_num, size_t(1)));
+
+    const size_t pixel_bytes = channels * bytes;
+    std::vector<uint8_t> row(packer.GetRowBytes());
+    for (size_t y = 0; y < info.vtex_height; ++y)
+    {
+        if (y < src_h)
+        {
+            fin.read(reinterpret_cast<char*>(row.data()), src_w * pixel_bytes);
+            if (static_cast<size_t>(fin.gcount()) != src_w * pixel_bytes) {
+                std::cerr << "source is shorter than " << src_w << "x" << src_h << "\n";
+                return 1;
+            }
+            for (size_t x = src_w; x < info.vtex_width; ++x) {
+                memcpy(&row[x * pixel_bytes], &row[(src_w - 1) * pixel_bytes], pixel_bytes);
+            }
+        }
+        if (!packer.AddRow(row.data())) {
+            std::cerr << "fail to write " << dst_path << "\n";
+            return 1;
+        }
+    }
+    if (!packer.Finish()) {
+        std::cerr << "fail to write " << dst_path << "\n";
+        return 1;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    std::cout << dst_path << ": " << info.vtex_width << "x" << info.vtex_height
+              << ", " << packer.GetLevelNum() << " levels, "
+              << clipmap::PageStreamer::CalcPageCount(info) << " pages, "
+              << std::chrono::duration<float>(end - begin).count() << " s\n";
+
+    return 0;
+}